@@ -33,10 +33,34 @@
 # error "You need a C++11 compiler to use lualite"
 #endif // __cplusplus
 
+#include <algorithm>
+
 #include <cassert>
 
+#include <chrono>
+
+#include <condition_variable>
+
+#include <cstdint>
+
+#include <cstdlib>
+
 #include <cstring>
 
+#include <exception>
+
+#include <mutex>
+
+#include <new>
+
+#if __cplusplus >= 201703L
+# include <string_view>
+#endif // __cplusplus
+
+#include <thread>
+
+#include <tuple>
+
 #include <type_traits>
 
 #include <unordered_map>
@@ -61,8 +85,6 @@
 
 #include <string>
 
-#include <tuple>
-
 #include <utility>
 
 #endif // LUALITE_NO_STD_CONTAINERS
@@ -78,6 +100,382 @@ namespace lualite
 
 struct any { };
 
+template <typename FP, FP fp> struct overload { };
+
+// borrows a Lua string for the duration of a call, like std::string_view
+class string_ref
+{
+public:
+  constexpr string_ref(char const* const data,
+    ::std::size_t const size) noexcept :
+    data_(data),
+    size_(size)
+  {
+  }
+
+  constexpr char const* data() const noexcept { return data_; }
+
+  constexpr ::std::size_t size() const noexcept { return size_; }
+
+private:
+  char const* data_;
+
+  ::std::size_t size_;
+};
+
+// a std::string or std::vector parameter decoded into per-thread storage
+// that keeps its capacity from call to call, e.g.
+// void f(reused<::std::vector<int> > v), valid until the function returns
+template <class T>
+class reused
+{
+public:
+  using value_type = T;
+
+  explicit reused(T const& v) noexcept : v_(&v) { }
+
+  operator T const&() const noexcept { return *v_; }
+
+  T const& operator*() const noexcept { return *v_; }
+
+  T const* operator->() const noexcept { return v_; }
+
+private:
+  T const* v_;
+};
+
+// a vector of numbers, in Lua a packed userdata indexed from 1
+template <typename T>
+class array : public ::std::vector<T>
+{
+  static_assert(::std::is_arithmetic<T>{}, "T must be arithmetic");
+
+public:
+  using ::std::vector<T>::vector;
+
+  array() = default;
+
+  array(::std::vector<T> const& v) : ::std::vector<T>(v) { }
+
+  array(::std::vector<T>&& v) noexcept : ::std::vector<T>(::std::move(v)) { }
+};
+
+// a data member of an aggregate, see fields
+template <typename MP, MP mp>
+struct field
+{
+  static_assert(::std::is_member_object_pointer<MP>{},
+    "MP must be a pointer to data member");
+};
+
+template <class ...F>
+struct field_list
+{
+};
+
+// specialize to convert an aggregate C to and from a table, e.g.
+//
+// template <>
+// struct fields<point> :
+//   field_list<field<LLFUNC(point::x)>, field<LLFUNC(point::y)> >
+// {
+//   static char const* const* names() noexcept
+//   {
+//     static char const* const n[]{"x", "y"};
+//
+//     return n;
+//   }
+// };
+template <class C>
+struct fields
+{
+};
+
+template <class C> struct columns;
+
+// a read-only view of a container, the container must outlive the view,
+// views returned by member functions or read from data members keep their
+// instance alive
+template <class C>
+class view
+{
+public:
+  using container_type = C;
+
+  explicit view(C const& c) noexcept : c_(&c) { }
+
+  C const& container() const noexcept { return *c_; }
+
+private:
+  C const* c_;
+};
+
+// the outcome of a protected call, on failure the message, with a
+// traceback, is left at the top of the stack and value is default
+// constructed
+template <typename R>
+struct call_result
+{
+  int status;
+
+  R value;
+
+  explicit operator bool() const noexcept { return LUA_OK == status; }
+};
+
+template <>
+struct call_result<void>
+{
+  int status;
+
+  explicit operator bool() const noexcept { return LUA_OK == status; }
+};
+
+// returned by a bound function to suspend the calling coroutine, yielding
+// the nresults values at the top of its stack, when resumed K(L) supplies
+// the results, or the values passed to resume do when there is no K
+template <lua_CFunction K = nullptr>
+struct suspend
+{
+  int nresults;
+};
+
+struct property_info
+{
+  char const* const name;
+
+  lua_CFunction const getter;
+  lua_CFunction const setter;
+};
+
+// a lua_Alloc bumping a pointer through chunks, memory is never reused
+// and is released all at once, one state at a time, e.g.
+// auto const L(region.new_state()); ... region.close(L);
+class region_allocator
+{
+public:
+  static constexpr ::std::size_t alignment{16};
+
+  static constexpr ::std::size_t chunk_size{256 * 1024};
+
+  region_allocator() = default;
+
+  region_allocator(region_allocator const&) = delete;
+
+  region_allocator& operator=(region_allocator const&) = delete;
+
+  ~region_allocator()
+  {
+    finalize();
+
+    release(nullptr);
+  }
+
+  lua_State* new_state() noexcept
+  {
+    return lua_newstate(alloc, this);
+  }
+
+  // replaces lua_close(), only the destructors of instances owned by L run,
+  // other __gc metamethods (e.g. of io files) do not, the first chunk is
+  // kept for the next state
+  void close(lua_State* const L) noexcept
+  {
+#ifndef NDEBUG
+    void* ud;
+
+    assert(alloc == lua_getallocf(L, &ud) && (this == ud));
+#else
+    static_cast<void>(L);
+#endif // NDEBUG
+
+    finalize();
+
+    release(first_);
+
+    if (first_)
+    {
+      top_ = first_ + alignment;
+      end_ = first_ + chunk_size;
+    }
+    // else do nothing
+  }
+
+  // f(object) is called by close(), unless the allocator is out of memory
+  bool track(void* const object, void (* const f)(void*)) noexcept
+  {
+    auto const n(static_cast<node*>(allocate(sizeof(node))));
+
+    if (n)
+    {
+      *n = {finalizers_, object, f};
+      finalizers_ = n;
+    }
+    // else do nothing
+
+    return n;
+  }
+
+  static void* alloc(void* const ud, void* const ptr,
+    ::std::size_t const osize, ::std::size_t const nsize) noexcept
+  {
+    auto const a(static_cast<region_allocator*>(ud));
+
+    if (!nsize)
+    {
+      return nullptr;
+    }
+    else if (!ptr)
+    {
+      return a->allocate(nsize);
+    }
+    else if (ptr == a->last_)
+    {
+      // the last block grows or shrinks in place
+      if (round(nsize) <= ::std::size_t(a->end_ - a->last_))
+      {
+        a->top_ = a->last_ + round(nsize);
+
+        return ptr;
+      }
+      // else do nothing
+    }
+    else if (nsize <= osize)
+    {
+      return ptr;
+    }
+    // else do nothing
+
+    auto const p(a->allocate(nsize));
+
+    if (p)
+    {
+      ::std::memcpy(p, ptr, osize < nsize ? osize : nsize);
+    }
+    // else do nothing
+
+    return p;
+  }
+
+private:
+  struct node
+  {
+    node* next;
+
+    void* object;
+
+    void (*finalize)(void*);
+  };
+
+  static constexpr ::std::size_t round(::std::size_t const size) noexcept
+  {
+    return (size + alignment - 1) & ~(alignment - 1);
+  }
+
+  // chunks start with a link to the previous chunk
+  char* new_chunk(::std::size_t const size) noexcept
+  {
+    auto const c(static_cast<char*>(::std::malloc(alignment + size)));
+
+    if (c)
+    {
+      *reinterpret_cast<char**>(c) = chunks_;
+      chunks_ = c;
+    }
+    // else do nothing
+
+    return c;
+  }
+
+  void* allocate(::std::size_t size) noexcept
+  {
+    size = round(size);
+
+    if (size > ::std::size_t(end_ - top_))
+    {
+      if (size > chunk_size / 4)
+      {
+        // large blocks get chunks of their own
+        auto const c(new_chunk(size));
+
+        return c ? c + alignment : nullptr;
+      }
+      else
+      {
+        auto const c(new_chunk(chunk_size - alignment));
+
+        if (!c)
+        {
+          return nullptr;
+        }
+        else if (!first_)
+        {
+          first_ = c;
+        }
+        // else do nothing
+
+        top_ = c + alignment;
+        end_ = c + chunk_size;
+      }
+    }
+    // else do nothing
+
+    last_ = top_;
+    top_ += size;
+
+    return last_;
+  }
+
+  void finalize() noexcept
+  {
+    for (auto n(finalizers_); n; n = n->next)
+    {
+      n->finalize(n->object);
+    }
+
+    finalizers_ = {};
+  }
+
+  void release(char* const keep) noexcept
+  {
+    for (auto c(chunks_); c;)
+    {
+      auto const next(*reinterpret_cast<char**>(c));
+
+      if (keep != c)
+      {
+        ::std::free(c);
+      }
+      // else do nothing
+
+      c = next;
+    }
+
+    if (keep)
+    {
+      *reinterpret_cast<char**>(keep) = nullptr;
+    }
+    else
+    {
+      first_ = top_ = end_ = {};
+    }
+
+    chunks_ = keep;
+    last_ = {};
+  }
+
+  char* chunks_{};
+
+  // the first regular chunk, reused after close()
+  char* first_{};
+
+  char* last_{};
+  char* top_{};
+  char* end_{};
+
+  node* finalizers_{};
+};
+
 class scope;
 
 template <class C> class class_;
@@ -85,6 +483,12 @@ template <class C> class class_;
 namespace detail
 {
 
+#ifdef LUALITE_CHECKED
+constexpr bool checked{true};
+#else
+constexpr bool checked{};
+#endif // LUALITE_CHECKED
+
 static constexpr auto const default_nrec = 10;
 
 template<typename T>
@@ -93,6 +497,14 @@ inline constexpr T const& as_const(T& t) noexcept
   return t;
 }
 
+template <bool ...>
+struct bool_pack;
+
+template <bool ...B>
+struct all_of : ::std::is_same<bool_pack<true, B...>, bool_pack<B..., true> >
+{
+};
+
 template <typename>
 struct is_function_pointer : ::std::false_type
 {
@@ -110,6 +522,38 @@ using is_nc_reference =
     !::std::is_const<typename ::std::remove_reference<T>::type>{}
   >;
 
+template <typename T>
+struct is_string_ref : ::std::is_same<T, string_ref>
+{
+};
+
+#if __cplusplus >= 201703L
+template <>
+struct is_string_ref<::std::string_view> : ::std::true_type
+{
+};
+#endif // __cplusplus
+
+template <typename>
+struct is_reused : ::std::false_type
+{
+};
+
+template <typename>
+struct is_view : ::std::false_type
+{
+};
+
+template <class C>
+struct is_view<view<C> > : ::std::true_type
+{
+};
+
+template <class T>
+struct is_reused<reused<T> > : ::std::true_type
+{
+};
+
 struct swallow { template <typename ...T> swallow(T&& ...) noexcept { } };
 
 // key is at the top of the stack
@@ -262,137 +706,547 @@ struct func_info_type
   lua_CFunction const callback;
 };
 
-using map_member_info_type = lua_CFunction;
+struct member_info_type
+{
+  char const* const name;
+
+  lua_CFunction const callback;
 
-using member_info_type = func_info_type;
+  bool const bound;
+};
 
-template <class C>
-int getter(lua_State* const L)
+struct object_header
 {
-  assert(2 == lua_gettop(L));
-  auto const i(lualite::class_<C>::getters_.find(lua_tostring(L, 2)));
+  void* instance;
 
-  if (lualite::class_<C>::getters_.end() == i)
-  {
-    return {};
-  }
-  else
-  {
-    auto const uvi(lua_upvalueindex(2));
+  bool owner;
+};
 
-    void* p(lua_touserdata(L, uvi));
-    auto const q(p);
+template <class C>
+struct class_tag
+{
+  static char const key;
 
-    for (auto const f: i->second.first)
-    {
-      p = f(p);
-    }
+  static char const cache;
+};
 
-    lua_pushlightuserdata(L, p);
-    lua_replace(L, uvi);
+template <class C>
+char const class_tag<C>::key{};
 
-    auto const se(make_scope_exit([&]() noexcept {
-      lua_pushlightuserdata(L, q); lua_replace(L, uvi);})
-    );
+template <class C>
+char const class_tag<C>::cache{};
 
-    return i->second.second(L);
-  }
-}
+using converter_type = void* (*)(void*);
 
-template <class C>
-int setter(lua_State* const L)
+// virtual bases need a converter, other bases are at an offset
+struct cast_step
 {
-  assert(3 == lua_gettop(L));
-  auto const i(lualite::class_<C>::setters_.find(lua_tostring(L, 2)));
+  converter_type convert;
 
-  if (lualite::class_<C>::setters_.end() != i)
-  {
-    auto const uvi(lua_upvalueindex(2));
+  ::std::ptrdiff_t offset;
+};
 
-    void* p(lua_touserdata(L, uvi));
-    auto const q(p);
+struct base_info_type
+{
+  char const* key;
+
+  cast_step step;
+};
+
+template <class A, class C, typename = void>
+struct is_virtual_base_of : ::std::is_base_of<A, C>
+{
+};
+
+template <class A, class C>
+struct is_virtual_base_of<A, C,
+  decltype(void(static_cast<C*>(::std::declval<A*>())))> : ::std::false_type
+{
+};
+
+// upvalue 1 holds the offset as a light userdata or, for virtual bases,
+// a userdata with the cast steps
+inline void* convert(lua_State* const L, void* p) noexcept
+{
+  auto const uvi(lua_upvalueindex(1));
+
+  if (lua_islightuserdata(L, uvi))
+  {
+    return static_cast<char*>(p) +
+      reinterpret_cast<::std::intptr_t>(lua_touserdata(L, uvi));
+  }
+  // else do nothing
 
-    for (auto const f: i->second.first)
+  auto i(static_cast<cast_step const*>(lua_touserdata(L, uvi)));
+
+  if (i)
+  {
+    for (auto const end(i + lua_rawlen(L, uvi) / sizeof(*i)); i != end; ++i)
     {
-      p = f(p);
+      p = i->convert ? i->convert(p) : static_cast<char*>(p) + i->offset;
     }
+  }
+  // else do nothing
 
-    lua_pushlightuserdata(L, p);
-    lua_replace(L, uvi);
+  return p;
+}
 
-    auto const se(make_scope_exit([&]() noexcept {
-      lua_pushlightuserdata(L, q); lua_replace(L, uvi);})
-    );
+// pushes the cast at index, preceded by step s
+inline void push_cast(lua_State* const L, int const index,
+  cast_step const& s)
+{
+  switch (lua_type(L, index))
+  {
+    case LUA_TNIL:
+      if (s.convert)
+      {
+        *static_cast<cast_step*>(lua_newuserdata(L, sizeof(s))) = s;
+      }
+      else
+      {
+        lua_pushlightuserdata(L, reinterpret_cast<void*>(s.offset));
+      }
+
+      break;
+
+    case LUA_TLIGHTUSERDATA:
+      {
+        auto const offset(reinterpret_cast<::std::intptr_t>(
+          lua_touserdata(L, index)));
 
-    i->second.second(L);
+        if (s.convert)
+        {
+          auto const c(static_cast<cast_step*>(
+            lua_newuserdata(L, 2 * sizeof(s))));
+
+          c[0] = s;
+          c[1] = {nullptr, offset};
+        }
+        else
+        {
+          lua_pushlightuserdata(L, reinterpret_cast<void*>(s.offset + offset));
+        }
+
+        break;
+      }
+
+    default:
+      {
+        auto const i(lua_absindex(L, index));
+        assert(lua_isuserdata(L, i));
+
+        auto const n(lua_rawlen(L, i) / sizeof(s));
+
+        auto const c(static_cast<cast_step*>(
+          lua_newuserdata(L, (n + 1) * sizeof(s))));
+
+        c[0] = s;
+        ::std::memcpy(c + 1, lua_touserdata(L, i), n * sizeof(s));
+      }
   }
-  // else do nothing
+}
 
-  return {};
+// the metatable is at the top of the stack, metatables of the bases are in
+// its array part
+inline bool inherits(lua_State* const L, char const* const name)
+{
+  rawgetfield(L, -1, "__name");
+
+  if (lua_isstring(L, -1) && !::std::strcmp(lua_tostring(L, -1), name))
+  {
+    lua_pop(L, 1);
+
+    return true;
+  }
+  else
+  {
+    lua_pop(L, 1);
+
+    for (decltype(lua_rawlen(L, -1)) i(1), n(lua_rawlen(L, -1)); i <= n; ++i)
+    {
+      lua_rawgeti(L, -1, i);
+
+      auto const r(inherits(L, name));
+
+      lua_pop(L, 1);
+
+      if (r)
+      {
+        return true;
+      }
+      // else do nothing
+    }
+
+    return false;
+  }
 }
 
-template <class C>
-inline void create_wrapper_table(lua_State* const L, C* const instance)
+// pushes the getter, method, bound method and setter tables of the
+// metatable at the top of the stack
+inline void push_accessors(lua_State* const L)
 {
-  auto const uvi(lua_upvalueindex(1));
+  rawgetfield(L, -1, "__index");
+  lua_getupvalue(L, -1, 1);
+  lua_getupvalue(L, -2, 2);
+  lua_getupvalue(L, -3, 3);
+  lua_remove(L, -4);
+
+  rawgetfield(L, -4, "__newindex");
+  lua_getupvalue(L, -1, 1);
+  lua_remove(L, -2);
+}
+
+// a static property of a base that needs a cast, upvalue 1 holds the cast
+// and upvalue 2 the property_info, whose accessor gets the cast instance
+template <lua_CFunction const property_info::* pm>
+int cast_property(lua_State* const L)
+{
+  object_header h{convert(L,
+    static_cast<object_header*>(lua_touserdata(L, 1))->instance), false};
 
-  lua_pushvalue(L, uvi);
+  lua_pushlightuserdata(L, &h);
+  lua_replace(L, 1);
 
-  if (lua_isnil(L, -1))
+  return (static_cast<property_info const*>(
+    lua_touserdata(L, lua_upvalueindex(2)))->*pm)(L);
+}
+
+inline bool is_cast_property(lua_CFunction const f) noexcept
+{
+  return (cast_property<&property_info::getter> == f) ||
+    (cast_property<&property_info::setter> == f);
+}
+
+// copies the entries of table src, whose names are missing from tables
+// first to last, into table dst and casts them with step s, metatable mt
+// goes into upvalue 2, unless it is 0
+inline void inherit(lua_State* const L, int const src, int const dst,
+  int const first, int const last, cast_step const& s,
+  lua_CFunction const property_info::* const pm, int const mt = {})
+{
+  lua_pushnil(L);
+
+  while (lua_next(L, src))
   {
-    lua_createtable(L, 0, default_nrec);
+    auto found(false);
 
-    for (auto& mi: lualite::class_<C>::defs_)
+    for (auto i(first); !found && (i <= last); ++i)
     {
-      assert(lua_istable(L, -1));
+      lua_pushvalue(L, -2);
+      lua_rawget(L, i);
 
-      lua_pushnil(L);
+      found = !lua_isnil(L, -1);
+
+      lua_pop(L, 1);
+    }
+
+    if (found)
+    {
+      lua_pop(L, 1);
+
+      continue;
+    }
+    else if (s.convert || s.offset || mt)
+    {
+      lua_CFunction f;
+
+      if (lua_islightuserdata(L, -1))
+      {
+        // static properties of the base become dynamic
+        f = &property_info::getter == pm ?
+          cast_property<&property_info::getter> :
+          cast_property<&property_info::setter>;
+
+        lua_pushnil(L);
+      }
+      else
+      {
+        f = lua_tocfunction(L, -1);
+
+        lua_getupvalue(L, -1, 1);
+      }
 
-      void* p(instance);
+      push_cast(L, -1, s);
 
-      for (auto const f: mi.first)
+      if (mt)
       {
-        p = f(p);
+        lua_pushvalue(L, mt);
+        lua_pushcclosure(L, f, 2);
       }
+      else if (is_cast_property(f))
+      {
+        // the property_info
+        if (lua_islightuserdata(L, -3))
+        {
+          lua_pushvalue(L, -3);
+        }
+        else
+        {
+          lua_getupvalue(L, -3, 2);
+        }
 
-      lua_pushlightuserdata(L, p);
-      lua_pushcclosure(L, mi.second.callback, 2);
+        lua_pushcclosure(L, f, 2);
+      }
+      else
+      {
+        lua_pushcclosure(L, f, 1);
+      }
 
-      rawsetfield(L, -2, mi.second.name);
+      lua_replace(L, -3);
+      lua_pop(L, 1);
     }
+    // else do nothing
 
-    // metatable
-    assert(lua_istable(L, -1));
-    lua_createtable(L, 0, 2);
+    lua_pushvalue(L, -2);
+    lua_insert(L, -2);
 
-    // getters
-    assert(lua_istable(L, -1));
+    lua_rawset(L, dst);
+  }
+}
 
-    lua_pushnil(L);
-    lua_pushlightuserdata(L, instance);
+// bound member functions carry their instance in upvalue 2
+template <::std::size_t O>
+inline typename ::std::enable_if<1 == O, void*>::type
+self(lua_State* const L) noexcept
+{
+  return convert(L, static_cast<object_header*>(
+    lua_touserdata(L, lua_upvalueindex(2)))->instance);
+}
+
+// methods carry the metatable of their class in upvalue 2 when checked
+inline void check_self(lua_State* const L)
+{
+  if (lua_getmetatable(L, 1) && lua_rawequal(L, -1, lua_upvalueindex(2)))
+  {
+    lua_pop(L, 1);
+  }
+  else
+  {
+    rawgetfield(L, lua_upvalueindex(2), "__name");
 
-    lua_pushcclosure(L, getter<C>, 2);
+    luaL_argerror(L, 1,
+      lua_pushfstring(L, "%s expected", lua_tostring(L, -1)));
+  }
+}
 
-    rawsetfield(L, -2, "__index");
+// functions reachable from scripts, other than methods, check their first
+// argument when checked
+inline void check_metatable(lua_State* const L, void const* const key,
+  char const* const expected)
+{
+  lua_rawgetp(L, LUA_REGISTRYINDEX, key);
 
-    // setters
-    assert(lua_istable(L, -1));
+  if (lua_getmetatable(L, 1) && lua_rawequal(L, -1, -2))
+  {
+    lua_pop(L, 2);
+  }
+  else
+  {
+    luaL_argerror(L, 1, expected);
+  }
+}
 
-    lua_pushnil(L);
-    lua_pushlightuserdata(L, instance);
+// metamethods do not check their first argument, when checked scripts can
+// not get them from the metatable at the top of the stack
+inline void protect_metatable(lua_State* const L)
+{
+  if (checked)
+  {
+    lua_pushboolean(L, false);
+    rawsetfield(L, -2, "__metatable");
+  }
+  // else do nothing
+}
 
-    lua_pushcclosure(L, setter<C>, 2);
+template <::std::size_t O>
+inline typename ::std::enable_if<2 == O, void*>::type
+self(lua_State* const L) noexcept(!checked)
+{
+  if (checked)
+  {
+    check_self(L);
+  }
+  // else do nothing
 
-    rawsetfield(L, -2, "__newindex");
+  assert(lua_isuserdata(L, 1));
+  return convert(L, static_cast<object_header*>(
+    lua_touserdata(L, 1))->instance);
+}
+
+// accessors are only ever called with instances of their class
+template <::std::size_t O>
+inline typename ::std::enable_if<3 == O, void*>::type
+self(lua_State* const L) noexcept
+{
+  assert(lua_isuserdata(L, 1));
+  return convert(L, static_cast<object_header*>(
+    lua_touserdata(L, 1))->instance);
+}
+
+// metatable is at the top of the stack, instances of C are constructed in
+// the same block, right after the header
+template <class C>
+inline object_header* new_instance(lua_State* const L)
+{
+  auto const h(static_cast<object_header*>(lua_newuserdata(L,
+    sizeof(object_header) + alignof(C) - 1 + sizeof(C))));
+
+  h->instance = {};
+  h->owner = false;
+
+  lua_insert(L, -2);
+  lua_setmetatable(L, -2);
+
+  return h;
+}
+
+template <class C>
+inline void* instance_storage(object_header* const h) noexcept
+{
+  auto const a(alignof(C) - 1);
+
+  return reinterpret_cast<void*>(
+    (reinterpret_cast<::std::uintptr_t>(h + 1) + a) & ~::std::uintptr_t(a));
+}
+
+// instances are cached by address, in a weak table per class, raises an
+// error if C is not registered with the lua_State
+template <class C>
+inline void push_instance(lua_State* const L, C* const instance)
+{
+  lua_rawgetp(L, LUA_REGISTRYINDEX, &class_tag<C>::cache);
+
+  if (!lua_istable(L, -1))
+  {
+    luaL_error(L, "returned an instance of a class not registered with "
+      "this lua_State");
+  }
+  // else do nothing
+
+  lua_rawgetp(L, -1, instance);
+
+  if (lua_isnil(L, -1))
+  {
+    lua_pop(L, 1);
+
+    auto const h(static_cast<object_header*>(
+      lua_newuserdata(L, sizeof(object_header))));
+
+    h->instance = instance;
+    h->owner = false;
+
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &class_tag<C>::key);
+    assert(lua_istable(L, -1));
 
     lua_setmetatable(L, -2);
 
-    lua_copy(L, -1, uvi);
+    lua_pushvalue(L, -1);
+    lua_rawsetp(L, -3, instance);
   }
   // else do nothing
 
-  assert(lua_istable(L, uvi));
-  assert(lua_istable(L, -1));
+  lua_remove(L, -2);
+}
+
+// upvalues are the getter, method and bound method tables, keyed by name
+inline int getter(lua_State* const L)
+{
+  assert(2 == lua_gettop(L));
+
+  // getters
+  lua_pushvalue(L, 2);
+  lua_rawget(L, lua_upvalueindex(1));
+
+  switch (lua_type(L, -1))
+  {
+    case LUA_TLIGHTUSERDATA:
+      {
+        // static properties are called directly
+        auto const pi(static_cast<property_info const*>(
+          lua_touserdata(L, -1)));
+        lua_pop(L, 1);
+
+        return pi->getter(L);
+      }
+
+    case LUA_TFUNCTION:
+      lua_pushvalue(L, 1);
+      lua_pushvalue(L, 2);
+
+      lua_call(L, 2, LUA_MULTRET);
+
+      return lua_gettop(L) - 2;
+
+    default:
+      lua_pop(L, 1);
+  }
+
+  // methods
+  lua_pushvalue(L, 2);
+  lua_rawget(L, lua_upvalueindex(2));
+
+  if (!lua_isnil(L, -1))
+  {
+    return 1;
+  }
+  // else do nothing
+
+  lua_pop(L, 1);
+
+  // bound methods
+  lua_pushvalue(L, 2);
+  lua_rawget(L, lua_upvalueindex(3));
+
+  if (lua_isnil(L, -1))
+  {
+    return 1;
+  }
+  else
+  {
+    auto const f(lua_tocfunction(L, -1));
+
+    lua_getupvalue(L, -1, 1);
+    lua_pushvalue(L, 1);
+
+    lua_pushcclosure(L, f, 2);
+
+    return 1;
+  }
+}
+
+// upvalue is the setter table, keyed by name
+inline int setter(lua_State* const L)
+{
+  assert(3 == lua_gettop(L));
+
+  lua_pushvalue(L, 2);
+  lua_rawget(L, lua_upvalueindex(1));
+
+  switch (lua_type(L, -1))
+  {
+    case LUA_TLIGHTUSERDATA:
+      {
+        auto const pi(static_cast<property_info const*>(
+          lua_touserdata(L, -1)));
+        lua_pop(L, 1);
+
+        pi->setter(L);
+
+        break;
+      }
+
+    case LUA_TFUNCTION:
+      lua_insert(L, 1);
+
+      lua_call(L, 3, 0);
+
+      break;
+
+    default:
+      lua_pop(L, 1);
+  }
+
+  return {};
 }
 
 template <typename T>
@@ -444,6 +1298,18 @@ set_result(lua_State* const L, T&& v) noexcept
   return 1;
 }
 
+template <typename T>
+inline typename ::std::enable_if<
+  is_string_ref<typename ::std::decay<T>::type>{} &&
+  !is_nc_reference<T>{},
+  int>::type
+set_result(lua_State* const L, T&& v) noexcept
+{
+  lua_pushlstring(L, v.data(), v.size());
+
+  return 1;
+}
+
 template <typename T>
 inline typename ::std::enable_if<
   ::std::is_same<typename ::std::decay<T>::type, void const*>{} &&
@@ -489,9 +1355,9 @@ inline typename ::std::enable_if<
     typename ::std::decay<T>::type>::type
   >{},
   int>::type
-set_result(lua_State* const L, T&& v) noexcept
+set_result(lua_State* const L, T&& v)
 {
-  create_wrapper_table(L, v);
+  push_instance(L, v);
 
   return 1;
 }
@@ -501,9 +1367,9 @@ inline typename ::std::enable_if<
   is_nc_reference<T>{} &&
   ::std::is_class<typename ::std::decay<T>::type>{},
   int>::type
-set_result(lua_State* const L, T&& v) noexcept
+set_result(lua_State* const L, T&& v)
 {
-  create_wrapper_table(L, &v);
+  push_instance(L, &v);
 
   return 1;
 }
@@ -565,12 +1431,28 @@ get_arg(lua_State* const L) noexcept
 
 template <int I, typename T>
 inline typename ::std::enable_if<
-  ::std::is_pointer<T>{} &&
-  !::std::is_same<typename ::std::decay<T>::type, char const*>{},
+  is_string_ref<typename ::std::decay<T>::type>{} &&
+  !is_nc_reference<T>{},
   typename ::std::decay<T>::type>::type
 get_arg(lua_State* const L) noexcept
 {
-  assert(lua_islightuserdata(L, I));
+  assert(lua_isstring(L, I));
+
+  ::std::size_t len;
+
+  auto const s(lua_tolstring(L, I, &len));
+
+  return {s, len};
+}
+
+template <int I, typename T>
+inline typename ::std::enable_if<
+  ::std::is_pointer<T>{} &&
+  !::std::is_same<typename ::std::decay<T>::type, char const*>{},
+  typename ::std::decay<T>::type>::type
+get_arg(lua_State* const L) noexcept
+{
+  assert(lua_islightuserdata(L, I));
   return static_cast<T>(lua_touserdata(L, I));
 }
 
@@ -592,906 +1474,3790 @@ get_arg(lua_State* const) noexcept
   return any();
 }
 
-#ifndef LUALITE_NO_STD_CONTAINERS
-
 template <typename>
-struct is_std_pair : ::std::false_type { };
+struct is_packed_array : ::std::false_type { };
 
-template <class T1, class T2>
-struct is_std_pair<::std::pair<T1, T2> > : ::std::true_type { };
-
-template <typename>
-struct is_std_array : ::std::false_type { };
+template <typename T>
+struct is_packed_array<array<T> > : ::std::true_type { };
 
-template <typename T, ::std::size_t N>
-struct is_std_array<::std::array<T, N> > : ::std::true_type { };
+template <typename T>
+struct array_stubs
+{
+  static T* data(lua_State* const L) noexcept
+  {
+    assert(lua_isuserdata(L, 1));
+    return static_cast<T*>(lua_touserdata(L, 1));
+  }
 
-template <typename>
-struct is_std_deque : ::std::false_type { };
+  static ::std::size_t size(lua_State* const L) noexcept
+  {
+    return lua_rawlen(L, 1) / sizeof(T);
+  }
 
-template <typename T, class Alloc>
-struct is_std_deque<::std::deque<T, Alloc> > : ::std::true_type { };
+  // integer keys are elements, other keys are methods
+  static int index(lua_State* const L)
+  {
+    int isnum;
 
-template <typename>
-struct is_std_forward_list : ::std::false_type { };
+    auto const i(lua_tointegerx(L, 2, &isnum));
 
-template <typename T, class Alloc>
-struct is_std_forward_list<::std::forward_list<T, Alloc> > : ::std::true_type { };
+    if (isnum)
+    {
+      if ((i > 0) && (::std::size_t(i) <= size(L)))
+      {
+        return set_result(L, as_const(data(L)[i - 1]));
+      }
+      else
+      {
+        lua_pushnil(L);
+      }
+    }
+    else
+    {
+      lua_pushvalue(L, 2);
+      lua_rawget(L, lua_upvalueindex(1));
+    }
 
-template <typename>
-struct is_std_list : ::std::false_type { };
+    return 1;
+  }
 
-template <typename T, class Alloc>
-struct is_std_list<::std::list<T, Alloc> > : ::std::true_type { };
+  static int newindex(lua_State* const L)
+  {
+    int isnum;
 
-template <typename>
-struct is_std_map : ::std::false_type { };
+    auto const i(lua_tointegerx(L, 2, &isnum));
 
-template <class Key, class T, class Compare, class Alloc>
-struct is_std_map<::std::map<Key, T, Compare, Alloc> > : ::std::true_type { };
+    luaL_argcheck(L, isnum && (i > 0) && (::std::size_t(i) <= size(L)), 2,
+      "index out of range");
 
-template <typename>
-struct is_std_set : ::std::false_type { };
+    data(L)[i - 1] = get_arg<3, T>(L);
 
-template <class Key, class Compare, class Alloc>
-struct is_std_set<::std::set<Key, Compare, Alloc> > : ::std::true_type { };
+    return {};
+  }
 
-template <typename>
-struct is_std_unordered_map : ::std::false_type { };
+  static int len(lua_State* const L) noexcept
+  {
+    lua_pushinteger(L, size(L));
 
-template <class Key, class T, class Hash, class P, class Alloc>
-struct is_std_unordered_map<::std::unordered_map<Key, T, Hash, P, Alloc> > :
-  ::std::true_type { };
+    return 1;
+  }
 
-template <typename>
-struct is_std_unordered_set : ::std::false_type { };
+  static int totable(lua_State* const L)
+  {
+    if (checked)
+    {
+      check_metatable(L, &class_tag<array<T> >::key, "array expected");
+    }
+    // else do nothing
 
-template <class Key, class Hash, class Equal, class Alloc>
-struct is_std_unordered_set<::std::unordered_set<Key, Hash, Equal, Alloc> > :
-  ::std::true_type { };
+    auto const p(data(L));
+    auto const n(size(L));
 
-template <typename>
-struct is_std_tuple : ::std::false_type { };
+    lua_createtable(L, n, 0);
 
-template <class ...Types>
-struct is_std_tuple<::std::tuple<Types...> > : ::std::true_type { };
+    for (::std::size_t i{}; i != n; ++i)
+    {
+      set_result(L, as_const(p[i]));
 
-template <typename>
-struct is_std_vector : ::std::false_type { };
+      lua_rawseti(L, -2, i + 1);
+    }
 
-template <typename T, class Alloc>
-struct is_std_vector<::std::vector<T, Alloc> > : ::std::true_type { };
+    return 1;
+  }
+};
 
+// arrays of T in a lua_State share a single metatable
 template <typename T>
-inline typename ::std::enable_if<
-  ::std::is_same<typename ::std::decay<T>::type, ::std::string>{} &&
-  !is_nc_reference<T>{},
-  int>::type
-set_result(lua_State* const L, T&& s) noexcept
+void push_array_metatable(lua_State* const L)
 {
-  lua_pushlstring(L, s.c_str(), s.size());
-
-  return 1;
-}
+  auto const key(&class_tag<array<T> >::key);
 
-template <typename C>
-inline typename ::std::enable_if<
-  is_std_pair<typename ::std::decay<C>::type>{} &&
-  !is_nc_reference<C>{},
-  int>::type
-set_result(lua_State* const L, C&& p)
-  noexcept(noexcept(set_result(L, p.first), set_result(L, p.second)))
-{
-  set_result(L, p.first);
-  set_result(L, p.second);
+  lua_rawgetp(L, LUA_REGISTRYINDEX, key);
 
-  return 2;
-}
+  if (lua_isnil(L, -1))
+  {
+    lua_pop(L, 1);
 
-template <typename ...Types, ::std::size_t ...I>
-inline void set_tuple_result(lua_State* const L,
-  ::std::tuple<Types...> const& t, indices<I...> const)
-    noexcept(noexcept(swallow{
-      (set_result(L, ::std::get<I>(t)), 0)...
-    }))
-{
-  swallow{(set_result(L, ::std::get<I>(t)), 0)...};
-}
+    lua_createtable(L, 0, 3);
 
-template <typename C>
-inline typename ::std::enable_if<
-  is_std_tuple<typename ::std::decay<C>::type>{} &&
-  !is_nc_reference<C>{},
-  int>::type
-set_result(lua_State* const L, C&& t)
-  noexcept(noexcept(set_tuple_result(L, t,
-    make_indices<::std::tuple_size<C>{}>())))
-{
-  using result_type = typename ::std::decay<C>::type;
+    // methods
+    lua_createtable(L, 0, 1);
 
-  set_tuple_result(L, t, make_indices<::std::tuple_size<C>{}>());
+    lua_pushcfunction(L, array_stubs<T>::totable);
+    rawsetfield(L, -2, "totable");
 
-  return ::std::tuple_size<result_type>{};
-}
+    lua_pushcclosure(L, array_stubs<T>::index, 1);
+    rawsetfield(L, -2, "__index");
 
-template <typename C>
-inline typename ::std::enable_if<
-  is_std_array<typename ::std::decay<C>::type>{} &&
-  !is_nc_reference<C>{},
-  int>::type
-set_result(lua_State* const L, C&& a)
-{
-  lua_createtable(L, a.size(), 0);
+    lua_pushcfunction(L, array_stubs<T>::newindex);
+    rawsetfield(L, -2, "__newindex");
 
-  auto const cend(a.cend());
+    lua_pushcfunction(L, array_stubs<T>::len);
+    rawsetfield(L, -2, "__len");
 
-  for (auto i(a.cbegin()); i != cend; ++i)
-  {
-    set_result(L, *i);
+    protect_metatable(L);
 
-    lua_rawseti(L, -2, i - a.cbegin() + 1);
+    lua_pushvalue(L, -1);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, key);
   }
-
-  return 1;
+  // else do nothing
 }
 
-template <typename C>
+template <typename T>
 inline typename ::std::enable_if<
-  is_std_deque<typename ::std::decay<C>::type>{} &&
-  !is_nc_reference<C>{},
+  is_packed_array<typename ::std::decay<T>::type>{} &&
+  !is_nc_reference<T>{},
   int>::type
-set_result(lua_State* const L, C&& d)
+set_result(lua_State* const L, T&& a)
 {
-  lua_createtable(L, d.size(), 0);
+  using value_type = typename ::std::decay<T>::type::value_type;
 
-  auto const cbegin(d.cbegin());
-  auto const cend(d.cend());
+  auto const size(a.size() * sizeof(value_type));
 
-  for (auto i(d.cbegin()); i != cend; ++i)
-  {
-    set_result(L, *i);
+  auto const p(lua_newuserdata(L, size));
 
-    lua_rawset(L, -2, i - cbegin + 1);
+  if (size)
+  {
+    ::std::memcpy(p, a.data(), size);
   }
+  // else do nothing
+
+  push_array_metatable<value_type>(L);
+
+  lua_setmetatable(L, -2);
 
   return 1;
 }
 
-template <typename C>
+// tables are accepted too, but need a conversion per element
+template <int I, class C>
 inline typename ::std::enable_if<
-  is_std_forward_list<typename ::std::decay<C>::type>{} &&
+  is_packed_array<typename ::std::decay<C>::type>{} &&
   !is_nc_reference<C>{},
-  int>::type
-set_result(lua_State* const L, C&& l)
+  typename ::std::decay<C>::type>::type
+get_arg(lua_State* const L)
 {
-  lua_createtable(L, l.size(), 0);
-
-  auto j(typename ::std::decay<C>::type::size_type(1));
+  using result_type = typename ::std::decay<C>::type;
+  using value_type = typename result_type::value_type;
 
-  auto const cend(l.cend());
+  result_type result;
 
-  for (auto i(l.cbegin()); i != cend; ++i, ++j)
+  if (lua_istable(L, I))
   {
-    set_result(L, *i);
+    auto const i(lua_absindex(L, I));
 
-    lua_rawseti(L, -2, j);
-  }
-
-  return 1;
-}
-
-template <typename C>
-inline typename ::std::enable_if<
-  is_std_list<typename ::std::decay<C>::type>{} &&
-  !is_nc_reference<C>{},
-  int>::type
-set_result(lua_State* const L, C&& l)
-{
-  lua_createtable(L, l.size(), 0);
+    result.resize(lua_rawlen(L, i));
 
-  auto j(typename ::std::decay<C>::type::size_type(1));
+    auto const p(result.data());
 
-  auto const cend(l.cend());
+    for (auto j(result.size()); j; --j)
+    {
+      lua_rawgeti(L, i, j);
 
-  for (auto i(l.cbegin()); i != cend; ++i, ++j)
-  {
-    set_result(L, *i);
+      p[j - 1] = get_arg<-1, value_type>(L);
 
-    lua_rawseti(L, -2, j);
+      lua_pop(L, 1);
+    }
   }
+  else
+  {
+    auto const i(lua_absindex(L, I));
 
-  return 1;
-}
+    // only arrays of the same T share the registered metatable
+    if (lua_getmetatable(L, i))
+    {
+      lua_rawgetp(L, LUA_REGISTRYINDEX, &class_tag<result_type>::key);
 
-template <typename C>
-inline typename ::std::enable_if<
-  is_std_map<typename ::std::decay<C>::type>{} &&
-  !is_nc_reference<C>{},
-  int>::type
-set_result(lua_State* const L, C&& m)
-{
-  lua_createtable(L, 0, m.size());
+      if (!lua_rawequal(L, -1, -2))
+      {
+        luaL_argerror(L, i, "array of a different type");
+      }
+      // else do nothing
 
-  auto const cend(m.cend());
+      lua_pop(L, 2);
+    }
+    else
+    {
+      luaL_argerror(L, i, "array or table expected");
+    }
 
-  for (auto i(m.cbegin()); i != cend; ++i)
-  {
-    set_result(L, i->first);
-    set_result(L, i->second);
+    auto const p(static_cast<value_type const*>(lua_touserdata(L, i)));
 
-    lua_rawset(L, -3);
+    result.assign(p, p + lua_rawlen(L, i) / sizeof(value_type));
   }
 
-  return 1;
+  return result;
 }
 
-template <typename C>
-inline typename ::std::enable_if<
-  is_std_set<typename ::std::decay<C>::type>{} &&
-  !is_nc_reference<C>{},
-  int>::type
-set_result(lua_State* const L, C&& s)
+// conversions declared here are used by the container conversions below
+template <typename T, typename = void>
+struct has_fields : ::std::false_type
 {
-  lua_createtable(L, 0, s.size());
+};
 
-  auto j(typename ::std::decay<C>::type::size_type(1));
+template <typename T>
+struct has_fields<T, decltype(void(fields<T>::names()))> : ::std::true_type
+{
+};
 
-  auto const cend(s.cend());
+template <typename T>
+struct is_instance;
 
-  for (auto i(s.cbegin()); i != cend; ++i, ++j)
+template <typename T>
+inline typename ::std::enable_if<
+  has_fields<typename ::std::decay<T>::type>{} &&
+  !is_nc_reference<T>{},
+  int>::type
+set_result(lua_State*, T&&);
+
+template <int I, class C>
+inline typename ::std::enable_if<
+  has_fields<typename ::std::decay<C>::type>{} &&
+  !is_nc_reference<C>{},
+  typename ::std::decay<C>::type>::type
+get_arg(lua_State*);
+
+template <typename T>
+inline typename ::std::enable_if<
+  is_instance<typename ::std::decay<T>::type>{} &&
+  !is_nc_reference<T>{},
+  int>::type
+set_result(lua_State*, T&&);
+
+template <typename T>
+using uses_scratch = is_reused<typename ::std::decay<T>::type>;
+
+// restores the scratch storage of a parameter type, when a call returns
+template <typename T, typename = void>
+struct scratch_mark
+{
+};
+
+template <class ...>
+struct scratch_mark_list
+{
+  scratch_mark_list() noexcept { }
+};
+
+template <class A, class ...B>
+struct scratch_mark_list<A, B...>
+{
+  scratch_mark_list() noexcept { }
+
+  scratch_mark<A> a;
+
+  scratch_mark_list<B...> b;
+};
+
+template <bool, class ...A>
+struct scratch_marks_of
+{
+  scratch_marks_of() noexcept { }
+};
+
+template <class ...A>
+struct scratch_marks_of<true, A...>
+{
+  scratch_marks_of() noexcept { }
+
+  scratch_mark_list<A...> m;
+};
+
+// free unless a parameter is reused<T>
+template <class ...A>
+using scratch_marks =
+  scratch_marks_of<!all_of<!uses_scratch<A>{}...>{}, A...>;
+
+// a call made under lua_pcall(), see scratch_call()
+template <typename R, class F>
+class scratch_frame
+{
+public:
+  explicit scratch_frame(F& f) noexcept : f_(f) { }
+
+  void operator()()
   {
-    set_result(L, *i);
+    ::new (&s_) result{f_()};
+  }
 
-    lua_rawseti(L, -2, j);
+  R get()
+  {
+    auto const p(reinterpret_cast<result*>(&s_));
+
+    struct destroy
+    {
+      result* const p;
+
+      ~destroy() { p->~result(); }
+    } const d{p};
+
+    return ::std::forward<R>(p->r);
   }
 
-  return 1;
-}
+  ::std::exception_ptr error;
 
-template <typename C>
-inline typename ::std::enable_if<
-  is_std_unordered_map<typename ::std::decay<C>::type>{} &&
-  !is_nc_reference<C>{},
-  int>::type
-set_result(lua_State* const L, C&& m)
+private:
+  struct result
+  {
+    R r;
+  };
+
+  F& f_;
+
+  typename ::std::aligned_storage<sizeof(result), alignof(result)>::type s_;
+};
+
+template <class F>
+class scratch_frame<void, F>
 {
-  lua_createtable(L, 0, m.size());
+public:
+  explicit scratch_frame(F& f) noexcept : f_(f) { }
 
-  auto const cend(m.cend());
+  void operator()()
+  {
+    f_();
+  }
 
-  for (auto i(m.cbegin()); i != cend; ++i)
+  void get() noexcept
   {
-    set_result(L, i->first);
-    set_result(L, i->second);
+  }
 
-    lua_rawset(L, -3);
+  ::std::exception_ptr error;
+
+private:
+  F& f_;
+};
+
+// the frame is at the top of the stack, below it are copies of the
+// arguments
+template <class F>
+int scratch_run(lua_State* const L)
+{
+  auto& f(*static_cast<F*>(lua_touserdata(L, -1)));
+
+  lua_pop(L, 1);
+
+  // exceptions must not pass through lua_pcall()
+  try
+  {
+    f();
+  }
+  catch (::std::exception const&)
+  {
+    f.error = ::std::current_exception();
   }
 
-  return 1;
+  return {};
 }
 
-template <typename C>
+// a call with reused<T> parameters decodes its arguments and calls under
+// lua_pcall(), its marks are outside and restore the scratch storage even if
+// a Lua error jumps out of it
+template <class ...A, typename F>
 inline typename ::std::enable_if<
-  is_std_unordered_set<typename ::std::decay<C>::type>{} &&
-  !is_nc_reference<C>{},
-  int>::type
-set_result(lua_State* const L, C&& s)
+  all_of<!uses_scratch<A>{}...>{},
+  decltype(::std::declval<F&>()())>::type
+scratch_call(lua_State* const, F&& f)
+  noexcept(noexcept(f()))
 {
-  lua_createtable(L, 0, s.size());
+  return f();
+}
 
-  auto j(typename ::std::decay<C>::type::size_type(1));
+template <class ...A, typename F>
+inline typename ::std::enable_if<
+  !all_of<!uses_scratch<A>{}...>{},
+  decltype(::std::declval<F&>()())>::type
+scratch_call(lua_State* const L, F&& f)
+{
+  using frame = scratch_frame<decltype(f()), F>;
 
-  auto const cend(s.cend());
+  frame c(f);
 
-  for (auto i(s.cbegin()); i != cend; ++i, ++j)
+  auto const n(lua_gettop(L));
+
+  luaL_checkstack(L, n + 2, "too many arguments");
+
+  lua_pushcfunction(L, scratch_run<frame>);
+
+  for (int i{1}; i <= n; ++i)
   {
-    set_result(L, *i);
+    lua_pushvalue(L, i);
+  }
 
-    lua_rawseti(L, -2, j);
+  lua_pushlightuserdata(L, &c);
+
+  int status;
+
+  {
+    scratch_marks<A...> const m{};
+
+    status = lua_pcall(L, n + 1, 0, 0);
   }
 
-  return 1;
+  if (LUA_OK != status)
+  {
+    lua_error(L);
+  }
+  else if (c.error)
+  {
+    ::std::rethrow_exception(c.error);
+  }
+  // else do nothing
+
+  return c.get();
 }
 
-template <typename C>
-inline typename ::std::enable_if<
-  is_std_vector<typename ::std::decay<C>::type>{} &&
-  !is_nc_reference<C>{},
-  int>::type
-set_result(lua_State* const L, C&& v)
+#ifndef LUALITE_NO_STD_CONTAINERS
+
+template <typename>
+struct is_std_pair : ::std::false_type { };
+
+template <class T1, class T2>
+struct is_std_pair<::std::pair<T1, T2> > : ::std::true_type { };
+
+template <typename>
+struct is_std_array : ::std::false_type { };
+
+template <typename T, ::std::size_t N>
+struct is_std_array<::std::array<T, N> > : ::std::true_type { };
+
+template <typename>
+struct is_std_deque : ::std::false_type { };
+
+template <typename T, class Alloc>
+struct is_std_deque<::std::deque<T, Alloc> > : ::std::true_type { };
+
+template <typename>
+struct is_std_forward_list : ::std::false_type { };
+
+template <typename T, class Alloc>
+struct is_std_forward_list<::std::forward_list<T, Alloc> > : ::std::true_type { };
+
+template <typename>
+struct is_std_list : ::std::false_type { };
+
+template <typename T, class Alloc>
+struct is_std_list<::std::list<T, Alloc> > : ::std::true_type { };
+
+template <typename>
+struct is_std_map : ::std::false_type { };
+
+template <class Key, class T, class Compare, class Alloc>
+struct is_std_map<::std::map<Key, T, Compare, Alloc> > : ::std::true_type { };
+
+template <typename>
+struct is_std_set : ::std::false_type { };
+
+template <class Key, class Compare, class Alloc>
+struct is_std_set<::std::set<Key, Compare, Alloc> > : ::std::true_type { };
+
+template <typename>
+struct is_std_unordered_map : ::std::false_type { };
+
+template <class Key, class T, class Hash, class P, class Alloc>
+struct is_std_unordered_map<::std::unordered_map<Key, T, Hash, P, Alloc> > :
+  ::std::true_type { };
+
+template <typename>
+struct is_std_unordered_set : ::std::false_type { };
+
+template <class Key, class Hash, class Equal, class Alloc>
+struct is_std_unordered_set<::std::unordered_set<Key, Hash, Equal, Alloc> > :
+  ::std::true_type { };
+
+template <typename>
+struct is_std_tuple : ::std::false_type { };
+
+template <class ...Types>
+struct is_std_tuple<::std::tuple<Types...> > : ::std::true_type { };
+
+template <typename>
+struct is_std_vector : ::std::false_type { };
+
+template <typename T, class Alloc>
+struct is_std_vector<::std::vector<T, Alloc> > : ::std::true_type { };
+
+// containers that can be decoded into storage reused from a previous call
+template <typename>
+struct is_reusable : ::std::false_type { };
+
+template <>
+struct is_reusable<::std::string> : ::std::true_type { };
+
+template <typename T, class Alloc>
+struct is_reusable<::std::vector<T, Alloc> > : ::std::integral_constant<bool,
+  !::std::is_same<T, bool>{} && ::std::is_default_constructible<T>{}>
 {
-  lua_createtable(L, v.size(), 0);
+};
 
-  auto const cbegin(v.cbegin());
-  auto const cend(v.cend());
+// larger buffers are freed when a smaller value is decoded into them
+constexpr ::std::size_t scratch_capacity{4096};
 
-  for (auto i(v.cbegin()); i != cend; ++i)
+// per-thread storage for reused<T> parameters, calls in progress use the
+// first used() objects
+template <class T>
+struct scratch
+{
+  static ::std::deque<T>& objects() noexcept
   {
-    set_result(L, *i);
+    static thread_local ::std::deque<T> o;
 
-    lua_rawseti(L, -2, i - cbegin + 1);
+    return o;
   }
 
-  return 1;
-}
+  static ::std::size_t& used() noexcept
+  {
+    static thread_local ::std::size_t u;
 
-template <int I, class C>
-inline typename ::std::enable_if<
-  ::std::is_same<typename ::std::decay<C>::type, ::std::string>{} &&
-  !is_nc_reference<C>{},
-  typename ::std::decay<C>::type>::type
-get_arg(lua_State* const L)
+    return u;
+  }
+
+  static T& acquire()
+  {
+    auto& o(objects());
+
+    if (used() == o.size())
+    {
+      o.emplace_back();
+    }
+    // else do nothing
+
+    return o[used()++];
+  }
+};
+
+template <typename T>
+struct scratch_mark<T, typename ::std::enable_if<uses_scratch<T>{}>::type>
 {
-  assert(lua_isstring(L, I));
+  using value_type = typename ::std::decay<T>::type::value_type;
 
-  ::std::size_t len;
+  scratch_mark() noexcept : m(scratch<value_type>::used())
+  {
+  }
 
-  auto const s(lua_tolstring(L, I, &len));
+  ~scratch_mark() noexcept
+  {
+    scratch<value_type>::used() = m;
+  }
 
-  return {s, len};
+  ::std::size_t const m;
+};
+
+template <typename T>
+inline typename ::std::enable_if<
+  ::std::is_same<typename ::std::decay<T>::type, ::std::string>{} &&
+  !is_nc_reference<T>{},
+  int>::type
+set_result(lua_State* const L, T&& s) noexcept
+{
+  lua_pushlstring(L, s.c_str(), s.size());
+
+  return 1;
 }
 
-template<int I, class C>
+template <typename C>
 inline typename ::std::enable_if<
   is_std_pair<typename ::std::decay<C>::type>{} &&
   !is_nc_reference<C>{},
-  typename ::std::decay<C>::type>::type
-get_arg(lua_State* const L)
+  int>::type
+set_result(lua_State* const L, C&& p)
+  noexcept(noexcept(set_result(L, p.first), set_result(L, p.second)))
 {
-  assert(lua_istable(L, I));
- 
-  using result_type = typename ::std::decay<C>::type;
+  set_result(L, p.first);
+  set_result(L, p.second);
+
+  return 2;
+}
+
+template <typename ...Types, ::std::size_t ...I>
+inline void set_tuple_result(lua_State* const L,
+  ::std::tuple<Types...> const& t, indices<I...> const)
+    noexcept(noexcept(swallow{
+      (set_result(L, ::std::get<I>(t)), 0)...
+    }))
+{
+  swallow{(set_result(L, ::std::get<I>(t)), 0)...};
+}
+
+template <typename C>
+inline typename ::std::enable_if<
+  is_std_tuple<typename ::std::decay<C>::type>{} &&
+  !is_nc_reference<C>{},
+  int>::type
+set_result(lua_State* const L, C&& t)
+  noexcept(noexcept(set_tuple_result(L, t,
+    make_indices<::std::tuple_size<typename ::std::decay<C>::type>{}>())))
+{
+  using result_type = typename ::std::decay<C>::type;
+
+  set_tuple_result(L, t, make_indices<::std::tuple_size<result_type>{}>());
+
+  return ::std::tuple_size<result_type>{};
+}
+
+template <typename C>
+inline typename ::std::enable_if<
+  is_std_array<typename ::std::decay<C>::type>{} &&
+  !is_nc_reference<C>{},
+  int>::type
+set_result(lua_State* const L, C&& a)
+{
+  lua_createtable(L, a.size(), 0);
+
+  auto const cend(a.cend());
+
+  for (auto i(a.cbegin()); i != cend; ++i)
+  {
+    set_result(L, *i);
+
+    lua_rawseti(L, -2, i - a.cbegin() + 1);
+  }
+
+  return 1;
+}
+
+template <typename C>
+inline typename ::std::enable_if<
+  is_std_deque<typename ::std::decay<C>::type>{} &&
+  !is_nc_reference<C>{},
+  int>::type
+set_result(lua_State* const L, C&& d)
+{
+  lua_createtable(L, d.size(), 0);
+
+  auto const cbegin(d.cbegin());
+  auto const cend(d.cend());
+
+  for (auto i(d.cbegin()); i != cend; ++i)
+  {
+    set_result(L, *i);
+
+    lua_rawset(L, -2, i - cbegin + 1);
+  }
+
+  return 1;
+}
+
+template <typename C>
+inline typename ::std::enable_if<
+  is_std_forward_list<typename ::std::decay<C>::type>{} &&
+  !is_nc_reference<C>{},
+  int>::type
+set_result(lua_State* const L, C&& l)
+{
+  lua_createtable(L, l.size(), 0);
+
+  auto j(typename ::std::decay<C>::type::size_type(1));
+
+  auto const cend(l.cend());
+
+  for (auto i(l.cbegin()); i != cend; ++i, ++j)
+  {
+    set_result(L, *i);
+
+    lua_rawseti(L, -2, j);
+  }
+
+  return 1;
+}
+
+template <typename C>
+inline typename ::std::enable_if<
+  is_std_list<typename ::std::decay<C>::type>{} &&
+  !is_nc_reference<C>{},
+  int>::type
+set_result(lua_State* const L, C&& l)
+{
+  lua_createtable(L, l.size(), 0);
+
+  auto j(typename ::std::decay<C>::type::size_type(1));
+
+  auto const cend(l.cend());
+
+  for (auto i(l.cbegin()); i != cend; ++i, ++j)
+  {
+    set_result(L, *i);
+
+    lua_rawseti(L, -2, j);
+  }
+
+  return 1;
+}
+
+template <typename C>
+inline typename ::std::enable_if<
+  is_std_map<typename ::std::decay<C>::type>{} &&
+  !is_nc_reference<C>{},
+  int>::type
+set_result(lua_State* const L, C&& m)
+{
+  lua_createtable(L, 0, m.size());
+
+  auto const cend(m.cend());
+
+  for (auto i(m.cbegin()); i != cend; ++i)
+  {
+    set_result(L, i->first);
+    set_result(L, i->second);
+
+    lua_rawset(L, -3);
+  }
+
+  return 1;
+}
+
+template <typename C>
+inline typename ::std::enable_if<
+  is_std_set<typename ::std::decay<C>::type>{} &&
+  !is_nc_reference<C>{},
+  int>::type
+set_result(lua_State* const L, C&& s)
+{
+  lua_createtable(L, 0, s.size());
+
+  auto j(typename ::std::decay<C>::type::size_type(1));
+
+  auto const cend(s.cend());
+
+  for (auto i(s.cbegin()); i != cend; ++i, ++j)
+  {
+    set_result(L, *i);
+
+    lua_rawseti(L, -2, j);
+  }
+
+  return 1;
+}
+
+template <typename C>
+inline typename ::std::enable_if<
+  is_std_unordered_map<typename ::std::decay<C>::type>{} &&
+  !is_nc_reference<C>{},
+  int>::type
+set_result(lua_State* const L, C&& m)
+{
+  lua_createtable(L, 0, m.size());
+
+  auto const cend(m.cend());
+
+  for (auto i(m.cbegin()); i != cend; ++i)
+  {
+    set_result(L, i->first);
+    set_result(L, i->second);
+
+    lua_rawset(L, -3);
+  }
+
+  return 1;
+}
+
+template <typename C>
+inline typename ::std::enable_if<
+  is_std_unordered_set<typename ::std::decay<C>::type>{} &&
+  !is_nc_reference<C>{},
+  int>::type
+set_result(lua_State* const L, C&& s)
+{
+  lua_createtable(L, 0, s.size());
+
+  auto j(typename ::std::decay<C>::type::size_type(1));
+
+  auto const cend(s.cend());
+
+  for (auto i(s.cbegin()); i != cend; ++i, ++j)
+  {
+    set_result(L, *i);
+
+    lua_rawseti(L, -2, j);
+  }
+
+  return 1;
+}
+
+template <typename C>
+inline typename ::std::enable_if<
+  is_std_vector<typename ::std::decay<C>::type>{} &&
+  !is_nc_reference<C>{},
+  int>::type
+set_result(lua_State* const L, C&& v)
+{
+  lua_createtable(L, v.size(), 0);
+
+  auto const cbegin(v.cbegin());
+  auto const cend(v.cend());
+
+  for (auto i(v.cbegin()); i != cend; ++i)
+  {
+    set_result(L, *i);
+
+    lua_rawseti(L, -2, i - cbegin + 1);
+  }
+
+  return 1;
+}
+
+template <int I, class C>
+inline typename ::std::enable_if<
+  ::std::is_same<typename ::std::decay<C>::type, ::std::string>{} &&
+  !is_nc_reference<C>{},
+  typename ::std::decay<C>::type>::type
+get_arg(lua_State* const L)
+{
+  assert(lua_isstring(L, I));
+
+  ::std::size_t len;
+
+  auto const s(lua_tolstring(L, I, &len));
+
+  return {s, len};
+}
+
+template<int I, class C>
+inline typename ::std::enable_if<
+  is_std_pair<typename ::std::decay<C>::type>{} &&
+  !is_nc_reference<C>{},
+  typename ::std::decay<C>::type>::type
+get_arg(lua_State* const L)
+{
+  assert(lua_istable(L, I));
+ 
+  using result_type = typename ::std::decay<C>::type;
+
+  auto const t(lua_absindex(L, I));
+
+  lua_rawgeti(L, t, 1);
+  lua_rawgeti(L, t, 2);
+
+  result_type result(
+    get_arg<-2, typename result_type::first_type>(L),
+    get_arg<-1, typename result_type::second_type>(L));
+
+  lua_pop(L, 2);
+
+  return result;
+}
+
+template <class C, ::std::size_t ...I>
+inline C get_tuple_arg(lua_State* const L, int const t, indices<I...> const)
+  noexcept(noexcept(::std::make_tuple(get_arg<int(I - sizeof...(I)),
+    typename ::std::tuple_element<I, C>::type>(L)...)))
+{
+  swallow{(lua_rawgeti(L, t, I + 1), 0)...};
+
+  C result(::std::make_tuple(get_arg<int(I - sizeof...(I)),
+    typename ::std::tuple_element<I, C>::type>(L)...));
+
+  lua_pop(L, int(sizeof...(I)));
+
+  return result;
+}
+
+template <int I, class C>
+inline typename ::std::enable_if<
+  is_std_tuple<typename ::std::decay<C>::type>{} &&
+  !is_nc_reference<C>{},
+  typename ::std::decay<C>::type>::type
+get_arg(lua_State* const L)
+  noexcept(noexcept(get_tuple_arg<typename ::std::decay<C>::type>(L, I,
+    make_indices<::std::tuple_size<typename ::std::decay<C>::type>{}>())))
+{
+  assert(lua_istable(L, I));
+
+  using result_type = typename ::std::decay<C>::type;
+
+  return get_tuple_arg<result_type>(L, lua_absindex(L, I),
+    make_indices<::std::tuple_size<result_type>{}>());
+}
+
+// elements are popped as they are decoded, so that nested containers find
+// their tables at the top of the stack
+template<int I, class C>
+inline typename ::std::enable_if<
+  is_std_array<typename ::std::decay<C>::type>{} &&
+  !is_nc_reference<C>{},
+  typename ::std::decay<C>::type>::type
+get_arg(lua_State* const L)
+{
+  assert(lua_istable(L, I));
+
+  using result_type = typename ::std::decay<C>::type;
+  result_type result;
+
+  auto const t(lua_absindex(L, I));
+
+  auto const end(::std::min(lua_rawlen(L, t), result.size()) + 1);
+
+  for (decltype(lua_rawlen(L, t)) i(1); i != end; ++i)
+  {
+    lua_rawgeti(L, t, i);
+
+    result[i - 1] = get_arg<-1, typename result_type::value_type>(L);
+
+    lua_pop(L, 1);
+  }
+
+  return result;
+}
+
+// a deque never relocates its elements, there is nothing to reserve
+template <int I, class C>
+inline typename ::std::enable_if<
+  is_std_deque<typename ::std::decay<C>::type>{} &&
+  !is_nc_reference<C>{},
+  typename ::std::decay<C>::type>::type
+get_arg(lua_State* const L)
+{
+  assert(lua_istable(L, I));
+
+  using result_type = typename ::std::decay<C>::type;
+  result_type result;
+
+  auto const t(lua_absindex(L, I));
+
+  auto const end(lua_rawlen(L, t) + 1);
+
+  for (decltype(lua_rawlen(L, t)) i(1); i != end; ++i)
+  {
+    lua_rawgeti(L, t, i);
+
+    result.emplace_back(get_arg<-1, typename result_type::value_type>(L));
+
+    lua_pop(L, 1);
+  }
+
+  return result;
+}
+
+template <int I, class C>
+inline typename ::std::enable_if<
+  is_std_forward_list<typename ::std::decay<C>::type>{} &&
+  !is_nc_reference<C>{},
+  typename ::std::decay<C>::type>::type
+get_arg(lua_State* const L)
+{
+  assert(lua_istable(L, I));
+
+  using result_type = typename ::std::decay<C>::type;
+  result_type result;
+
+  auto const t(lua_absindex(L, I));
+
+  for (auto i(lua_rawlen(L, t)); i; --i)
+  {
+    lua_rawgeti(L, t, i);
+
+    result.emplace_front(get_arg<-1, typename result_type::value_type>(L));
+
+    lua_pop(L, 1);
+  }
+
+  return result;
+}
+
+template <int I, class C>
+inline typename ::std::enable_if<
+  is_std_list<typename ::std::decay<C>::type>{} &&
+  !is_nc_reference<C>{},
+  typename ::std::decay<C>::type>::type
+get_arg(lua_State* const L)
+{
+  assert(lua_istable(L, I));
+
+  using result_type = typename ::std::decay<C>::type;
+  result_type result;
+
+  auto const t(lua_absindex(L, I));
+
+  auto const end(lua_rawlen(L, t) + 1);
+
+  for (decltype(lua_rawlen(L, t)) i(1); i != end; ++i)
+  {
+    lua_rawgeti(L, t, i);
+
+    result.emplace_back(get_arg<-1, typename result_type::value_type>(L));
+
+    lua_pop(L, 1);
+  }
+
+  return result;
+}
+
+template <int I, class C>
+inline typename ::std::enable_if<
+  is_std_vector<typename ::std::decay<C>::type>{} &&
+  !is_nc_reference<C>{},
+  typename ::std::decay<C>::type>::type
+get_arg(lua_State* const L)
+{
+  assert(lua_istable(L, I));
+
+  using result_type = typename ::std::decay<C>::type;
+  result_type result;
+
+  auto const t(lua_absindex(L, I));
+
+  auto const end(lua_rawlen(L, t) + 1);
+
+  result.reserve(end - 1);
+
+  for (decltype(lua_rawlen(L, t)) i(1); i != end; ++i)
+  {
+    lua_rawgeti(L, t, i);
+
+    result.emplace_back(get_arg<-1, typename result_type::value_type>(L));
+
+    lua_pop(L, 1);
+  }
+
+  return result;
+}
+
+// the number of pairs in the table at index t, for presizing
+inline ::std::size_t count_pairs(lua_State* const L, int const t) noexcept
+{
+  ::std::size_t n{};
+
+  lua_pushnil(L);
+
+  while (lua_next(L, t))
+  {
+    ++n;
+
+    lua_pop(L, 1);
+  }
+
+  return n;
+}
+
+// keys are decoded from a copy, lua_tolstring() would confuse lua_next()
+template <int I, class C>
+inline typename ::std::enable_if<
+  is_std_map<typename ::std::decay<C>::type>{} &&
+  !is_nc_reference<C>{},
+  typename ::std::decay<C>::type>::type
+get_arg(lua_State* const L)
+{
+  assert(lua_istable(L, I));
+
+  using result_type = typename ::std::decay<C>::type;
+  result_type result;
+
+  auto const t(lua_absindex(L, I));
+
+  lua_pushnil(L);
+
+  while (lua_next(L, t))
+  {
+    lua_pushvalue(L, -2);
+
+    result.emplace_hint(result.cend(),
+      get_arg<-1, typename result_type::key_type>(L),
+      get_arg<-2, typename result_type::mapped_type>(L));
+
+    lua_pop(L, 2);
+  }
+
+  return result;
+}
+
+template <int I, class C>
+inline typename ::std::enable_if<
+  is_std_set<typename ::std::decay<C>::type>{} &&
+  !is_nc_reference<C>{},
+  typename ::std::decay<C>::type>::type
+get_arg(lua_State* const L)
+{
+  assert(lua_istable(L, I));
+
+  using result_type = typename ::std::decay<C>::type;
+  result_type result;
+
+  auto const t(lua_absindex(L, I));
+
+  auto const end(lua_rawlen(L, t) + 1);
+
+  for (decltype(lua_rawlen(L, t)) i(1); i != end; ++i)
+  {
+    lua_rawgeti(L, t, i);
+
+    result.emplace_hint(result.cend(),
+      get_arg<-1, typename result_type::value_type>(L));
+
+    lua_pop(L, 1);
+  }
+
+  return result;
+}
+
+template <int I, class C>
+inline typename ::std::enable_if<
+  is_std_unordered_map<typename ::std::decay<C>::type>{} &&
+  !is_nc_reference<C>{},
+  typename ::std::decay<C>::type>::type
+get_arg(lua_State* const L)
+{
+  assert(lua_istable(L, I));
+
+  using result_type = typename ::std::decay<C>::type;
+  result_type result;
+
+  auto const t(lua_absindex(L, I));
+
+  result.reserve(count_pairs(L, t));
+
+  lua_pushnil(L);
+
+  while (lua_next(L, t))
+  {
+    lua_pushvalue(L, -2);
+
+    result.emplace(get_arg<-1, typename result_type::key_type>(L),
+      get_arg<-2, typename result_type::mapped_type>(L));
+
+    lua_pop(L, 2);
+  }
+
+  return result;
+}
+
+template <int I, class C>
+inline typename ::std::enable_if<
+  is_std_unordered_set<typename ::std::decay<C>::type>{} &&
+  !is_nc_reference<C>{},
+  typename ::std::decay<C>::type>::type
+get_arg(lua_State* const L)
+{
+  assert(lua_istable(L, I));
+
+  using result_type = typename ::std::decay<C>::type;
+  result_type result;
+
+  auto const t(lua_absindex(L, I));
+
+  auto const end(lua_rawlen(L, t) + 1);
+
+  result.reserve(end - 1);
+
+  for (decltype(lua_rawlen(L, t)) i(1); i != end; ++i)
+  {
+    lua_rawgeti(L, t, i);
+
+    result.emplace(get_arg<-1, typename result_type::value_type>(L));
+
+    lua_pop(L, 1);
+  }
+
+  return result;
+}
+
+// decodes into v, keeping the capacity v already has
+template <int I, typename T>
+inline void get_arg_into(lua_State* const L, T& v)
+{
+  v = get_arg<I, T>(L);
+}
+
+template <int I>
+inline void get_arg_into(lua_State* const L, ::std::string& v)
+{
+  assert(lua_isstring(L, I));
+
+  ::std::size_t len;
+
+  auto const s(lua_tolstring(L, I, &len));
+
+  if ((v.capacity() > scratch_capacity) && (len <= scratch_capacity))
+  {
+    ::std::string().swap(v);
+  }
+  // else do nothing
+
+  v.assign(s, len);
+}
+
+template <int I, typename T, class Alloc>
+inline typename ::std::enable_if<
+  is_reusable<::std::vector<T, Alloc> >{}>::type
+get_arg_into(lua_State* const L, ::std::vector<T, Alloc>& v)
+{
+  assert(lua_istable(L, I));
+
+  auto const t(lua_absindex(L, I));
+
+  auto const n(lua_rawlen(L, t));
+
+  if ((v.capacity() * sizeof(T) > scratch_capacity) &&
+    (n * sizeof(T) <= scratch_capacity))
+  {
+    ::std::vector<T, Alloc>().swap(v);
+  }
+  // else do nothing
+
+  v.resize(n);
+
+  for (decltype(v.size()) i{}; i != v.size(); ++i)
+  {
+    lua_rawgeti(L, t, i + 1);
+
+    get_arg_into<-1>(L, v[i]);
+
+    lua_pop(L, 1);
+  }
+}
+
+// see scratch_marks
+template <int I, class C>
+inline typename ::std::enable_if<
+  uses_scratch<C>{} &&
+  !is_nc_reference<C>{},
+  typename ::std::decay<C>::type>::type
+get_arg(lua_State* const L)
+{
+  using value_type = typename ::std::decay<C>::type::value_type;
+
+  static_assert(is_reusable<value_type>{},
+    "only std::string and std::vector can be reused");
+
+  auto& r(scratch<value_type>::acquire());
+
+  get_arg_into<I>(L, r);
+
+  return typename ::std::decay<C>::type(r);
+}
+
+template <class C>
+void push_view_metatable(lua_State*);
+
+// elements are converted on access, see view_stubs
+template <typename T>
+inline typename ::std::enable_if<
+  is_view<typename ::std::decay<T>::type>{} &&
+  !is_nc_reference<T>{},
+  int>::type
+set_result(lua_State* const L, T&& v)
+{
+  using container_type = typename ::std::decay<T>::type::container_type;
+
+  *static_cast<container_type const**>(
+    lua_newuserdata(L, sizeof(container_type const*))) = &v.container();
+
+  push_view_metatable<container_type>(L);
+
+  lua_setmetatable(L, -2);
+
+  return 1;
+}
+
+#endif // LUALITE_NO_STD_CONTAINERS
+
+template <class ...F>
+constexpr ::std::size_t field_count(field_list<F...> const) noexcept
+{
+  return sizeof...(F);
+}
+
+// field names are interned once per lua_State, into an array in the
+// registry
+template <class C>
+inline void push_field_keys(lua_State* const L, ::std::size_t const n)
+{
+  auto const key(&class_tag<fields<C> >::key);
+
+  lua_rawgetp(L, LUA_REGISTRYINDEX, key);
+
+  if (lua_isnil(L, -1))
+  {
+    lua_pop(L, 1);
+
+    lua_createtable(L, n, 0);
+
+    auto const names(fields<C>::names());
+
+    for (::std::size_t i{}; i != n; ++i)
+    {
+      lua_pushstring(L, names[i]);
+      lua_rawseti(L, -2, i + 1);
+    }
+
+    lua_pushvalue(L, -1);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, key);
+  }
+  // else do nothing
+}
+
+// the table is below the keys
+template <class C, typename ...MP, MP ...mp, ::std::size_t ...I>
+inline void set_fields(lua_State* const L, C const& c,
+  field_list<field<MP, mp>...> const, indices<I...> const)
+{
+  swallow{(lua_rawgeti(L, -1, I + 1), set_result(L, c.*mp),
+    lua_rawset(L, -4), 0)...};
+}
+
+// the keys are at the top of the stack, missing fields are left alone
+template <::std::size_t I, typename T>
+inline void get_field(lua_State* const L, int const t, T& v)
+{
+  lua_rawgeti(L, -1, I + 1);
+  lua_rawget(L, t);
+
+  if (!lua_isnil(L, -1))
+  {
+    v = get_arg<-1, T>(L);
+  }
+  // else do nothing
+
+  lua_pop(L, 1);
+}
+
+template <class C, typename ...MP, MP ...mp, ::std::size_t ...I>
+inline void get_fields(lua_State* const L, int const t, C& c,
+  field_list<field<MP, mp>...> const, indices<I...> const)
+{
+  swallow{(get_field<I>(L, t, c.*mp), 0)...};
+}
+
+template <typename T>
+inline typename ::std::enable_if<
+  has_fields<typename ::std::decay<T>::type>{} &&
+  !is_nc_reference<T>{},
+  int>::type
+set_result(lua_State* const L, T&& v)
+{
+  using fields_type = fields<typename ::std::decay<T>::type>;
+
+  constexpr auto n(field_count(fields_type()));
+
+  lua_createtable(L, 0, n);
+
+  push_field_keys<typename ::std::decay<T>::type>(L, n);
+
+  set_fields(L, v, fields_type(), make_indices<n>());
+
+  lua_pop(L, 1);
+
+  return 1;
+}
+
+template <int I, class C>
+inline typename ::std::enable_if<
+  has_fields<typename ::std::decay<C>::type>{} &&
+  !is_nc_reference<C>{},
+  typename ::std::decay<C>::type>::type
+get_arg(lua_State* const L)
+{
+  assert(lua_istable(L, I));
+
+  using result_type = typename ::std::decay<C>::type;
+  result_type result{};
+
+  constexpr auto n(field_count(fields<result_type>()));
+
+  auto const t(lua_absindex(L, I));
+
+  push_field_keys<result_type>(L, n);
+
+  get_fields(L, t, result, fields<result_type>(), make_indices<n>());
+
+  lua_pop(L, 1);
+
+  return result;
+}
+
+#ifndef LUALITE_NO_STD_CONTAINERS
+
+template <typename>
+struct member_type;
+
+template <class C, typename T>
+struct member_type<T C::*>
+{
+  using type = T;
+};
+
+template <class>
+struct columns_of;
+
+template <typename ...MP, MP ...mp>
+struct columns_of<field_list<field<MP, mp>...> >
+{
+  using type = ::std::tuple<::std::vector<typename member_type<MP>::type>...>;
+};
+
+template <typename>
+struct is_columns : ::std::false_type { };
+
+template <class C>
+struct is_columns<columns<C> > : ::std::true_type { };
+
+// the keys are below the record at the top of the stack
+template <::std::size_t J, typename T>
+inline void get_column(lua_State* const L, ::std::vector<T>& v)
+{
+  lua_rawgeti(L, -2, J + 1);
+  lua_rawget(L, -2);
+
+  if (lua_isnil(L, -1))
+  {
+    v.emplace_back();
+  }
+  else
+  {
+    v.emplace_back(get_arg<-1, T>(L));
+  }
+
+  lua_pop(L, 1);
+}
+
+template <class C, ::std::size_t ...J>
+inline void get_columns(lua_State* const L, C& c, indices<J...> const)
+{
+  swallow{(get_column<J>(L, ::std::get<J>(c)), 0)...};
+}
+
+template <class C, ::std::size_t ...J>
+inline void reserve_columns(C& c, ::std::size_t const n, indices<J...> const)
+{
+  swallow{(::std::get<J>(c).reserve(n), 0)...};
+}
+
+// records are decoded field by field, straight into their columns
+template <int I, class C>
+inline typename ::std::enable_if<
+  is_columns<typename ::std::decay<C>::type>{} &&
+  !is_nc_reference<C>{},
+  typename ::std::decay<C>::type>::type
+get_arg(lua_State* const L)
+{
+  assert(lua_istable(L, I));
+
+  using result_type = typename ::std::decay<C>::type;
+  using record_type = typename result_type::record_type;
+  result_type result;
+
+  constexpr auto n(field_count(fields<record_type>()));
+
+  auto const t(lua_absindex(L, I));
+
+  auto const end(lua_rawlen(L, t) + 1);
+
+  reserve_columns(result, end - 1, make_indices<n>());
+
+  push_field_keys<record_type>(L, n);
+
+  for (decltype(lua_rawlen(L, t)) i(1); i != end; ++i)
+  {
+    lua_rawgeti(L, t, i);
+    assert(lua_istable(L, -1));
+
+    get_columns(L, result, make_indices<n>());
+
+    lua_pop(L, 1);
+  }
+
+  lua_pop(L, 1);
+
+  return result;
+}
+
+#endif // LUALITE_NO_STD_CONTAINERS
+
+template <typename>
+struct is_suspend : ::std::false_type
+{
+};
+
+template <lua_CFunction K>
+struct is_suspend<suspend<K> > : ::std::true_type
+{
+};
+
+// class types without a conversion of their own are instances
+template <typename T>
+struct is_instance : ::std::integral_constant<bool,
+  ::std::is_class<T>{} &&
+  !::std::is_same<T, any>{} &&
+  !has_fields<T>{} &&
+  !is_packed_array<T>{} &&
+  !is_string_ref<T>{} &&
+  !is_reused<T>{} &&
+  !is_suspend<T>{}
+#ifndef LUALITE_NO_STD_CONTAINERS
+  && !::std::is_same<T, ::std::string>{} &&
+  !is_std_array<T>{} &&
+  !is_std_deque<T>{} &&
+  !is_std_forward_list<T>{} &&
+  !is_std_list<T>{} &&
+  !is_std_map<T>{} &&
+  !is_std_pair<T>{} &&
+  !is_std_set<T>{} &&
+  !is_std_tuple<T>{} &&
+  !is_std_unordered_map<T>{} &&
+  !is_std_unordered_set<T>{} &&
+  !is_std_vector<T>{} &&
+  !is_view<T>{}
+#endif // LUALITE_NO_STD_CONTAINERS
+>
+{
+};
+
+template <class C>
+inline void finalize_instance(void* const p)
+  noexcept(noexcept(::std::declval<C>().~C()))
+{
+  auto const h(static_cast<object_header*>(p));
+
+  if (h->owner)
+  {
+    h->owner = false;
+
+    static_cast<C*>(h->instance)->~C();
+  }
+  // else do nothing
+}
+
+// a region destroys the instances its state still owns when it is closed
+template <class C>
+inline void track_instance(lua_State* const L, object_header* const h)
+{
+  void* ud;
+
+  if ((region_allocator::alloc == lua_getallocf(L, &ud)) &&
+    !static_cast<region_allocator*>(ud)->track(h, finalize_instance<C>))
+  {
+    luaL_error(L, "not enough memory");
+  }
+  // else do nothing
+}
+
+// instances returned by value are moved into a userdata, the class must be
+// registered with the lua_State
+template <typename T>
+inline typename ::std::enable_if<
+  is_instance<typename ::std::decay<T>::type>{} &&
+  !is_nc_reference<T>{},
+  int>::type
+set_result(lua_State* const L, T&& v)
+{
+  using class_type = typename ::std::decay<T>::type;
+
+  lua_rawgetp(L, LUA_REGISTRYINDEX, &class_tag<class_type>::key);
+
+  if (!lua_istable(L, -1))
+  {
+    luaL_error(L, "returned an instance of a class not registered with "
+      "this lua_State");
+  }
+  // else do nothing
+
+  auto const h(new_instance<class_type>(L));
+
+  h->instance = ::new (instance_storage<class_type>(h))
+    class_type(::std::forward<T>(v));
+  h->owner = true;
+
+  track_instance<class_type>(L, h);
+
+  lua_rawgetp(L, LUA_REGISTRYINDEX, &class_tag<class_type>::cache);
+  assert(lua_istable(L, -1));
+
+  lua_pushvalue(L, -2);
+  lua_rawsetp(L, -2, h->instance);
+
+  lua_pop(L, 1);
+
+  return 1;
+}
+
+template <class C>
+int default_finalizer(lua_State* const L)
+  noexcept(noexcept(finalize_instance<C>(nullptr)))
+{
+  finalize_instance<C>(lua_touserdata(L, 1));
+
+  return {};
+}
+
+template <::std::size_t O, typename C, typename ...A, ::std::size_t ...I>
+inline typename ::std::enable_if<bool(!sizeof...(A)), C*>::type
+forward(lua_State* const, void* const p, indices<I...> const)
+  noexcept(noexcept(C()))
+{
+  return ::new (p) C();
+}
+
+template <::std::size_t O, typename C, typename ...A, ::std::size_t ...I>
+inline typename ::std::enable_if<bool(sizeof...(A)), C*>::type
+forward(lua_State* const L, void* const p, indices<I...> const)
+  noexcept(noexcept(C(get_arg<I + O, A>(L)...)))
+{
+  return scratch_call<A...>(L, [&]() -> C*
+    {
+      return ::new (p) C(get_arg<I + O, A>(L)...);
+    }
+  );
+}
+
+template <::std::size_t O, class C, class ...A>
+int constructor_stub(lua_State* const L)
+  noexcept(noexcept(forward<O, C, A...>(L, nullptr,
+    make_indices<sizeof...(A)>())))
+{
+  assert(sizeof...(A) == lua_gettop(L));
+
+  // the class metatable is in upvalue 1
+  lua_pushvalue(L, lua_upvalueindex(1));
+  assert(lua_istable(L, -1));
+
+  auto const h(new_instance<C>(L));
+
+  h->instance = forward<O, C, A...>(L, instance_storage<C>(h),
+    make_indices<sizeof...(A)>());
+  h->owner = true;
+
+  track_instance<C>(L, h);
+
+  // the instance cache is in upvalue 2
+  lua_pushvalue(L, -1);
+  lua_rawsetp(L, lua_upvalueindex(2), h->instance);
+
+  return 1;
+}
+
+template <::std::size_t O, typename R, typename ...A, ::std::size_t ...I>
+inline typename ::std::enable_if<bool(!sizeof...(A)), R>::type
+forward(lua_State* const, R (* const f)(A...), indices<I...> const)
+  noexcept(noexcept((*f)()))
+{
+  return (*f)();
+}
+
+template <::std::size_t O, typename R, typename ...A, ::std::size_t ...I>
+inline typename ::std::enable_if<bool(sizeof...(A)), R>::type
+forward(lua_State* const L, R (* const f)(A...), indices<I...> const)
+  noexcept(noexcept((*f)(get_arg<I + O, A>(L)...)))
+{
+  return scratch_call<A...>(L, [&]() -> R
+    {
+      return (*f)(get_arg<I + O, A>(L)...);
+    }
+  );
+}
+
+#if LUA_VERSION_NUM >= 503
+template <lua_CFunction K>
+int continuation(lua_State* const L, int, lua_KContext)
+{
+  return K(L);
+}
+#else
+template <lua_CFunction K>
+int continuation(lua_State* const L)
+{
+  return K(L);
+}
+#endif // LUA_VERSION_NUM
+
+// lua_yieldk() does not return, the bound function and its arguments are
+// gone by now
+inline int yield(lua_State* const L, suspend<> const s)
+{
+  return lua_yield(L, s.nresults);
+}
+
+template <lua_CFunction K>
+inline int yield(lua_State* const L, suspend<K> const s)
+{
+  return lua_yieldk(L, s.nresults, 0, continuation<K>);
+}
+
+template <lua_CFunction K>
+inline int set_result(lua_State* const L, suspend<K> const s)
+{
+  return yield(L, s);
+}
+
+template <typename FP, FP fp, ::std::size_t O, class R, class ...A>
+typename ::std::enable_if<::std::is_void<R>{}, int>::type
+func_stub(lua_State* const L)
+  noexcept(noexcept(forward<O, R, A...>(L, fp, make_indices<sizeof...(A)>())))
+{
+  assert(sizeof...(A) == lua_gettop(L));
+
+  forward<O, R, A...>(L, fp, make_indices<sizeof...(A)>());
+
+  return {};
+}
+
+template <typename FP, FP fp, ::std::size_t O, class R, class ...A>
+typename ::std::enable_if<!::std::is_void<R>{}, int>::type
+func_stub(lua_State* const L)
+  noexcept(noexcept(set_result(L, forward<O, R, A...>(L, fp,
+    make_indices<sizeof...(A)>()))))
+{
+  return set_result(L, forward<O, R, A...>(L, fp,
+    make_indices<sizeof...(A)>()));
+}
+
+template <typename FP, FP fp, class R>
+typename ::std::enable_if<::std::is_void<R>{}, int>::type
+vararg_func_stub(lua_State* const L)
+  noexcept(noexcept(fp(L)))
+{
+  fp(L);
+
+  return {};
+}
+
+template <typename FP, FP fp, class R>
+typename ::std::enable_if<!::std::is_void<R>{}, int>::type
+vararg_func_stub(lua_State* const L)
+  noexcept(noexcept(set_result(L, fp(L))))
+{
+  return set_result(L, fp(L));
+}
+
+// results of members, O is the offset of their arguments, see self()
+template <::std::size_t O, typename T>
+inline typename ::std::enable_if<
+  !is_view<typename ::std::decay<T>::type>{},
+  int>::type
+set_member_result(lua_State* const L, T&& v)
+  noexcept(noexcept(set_result(L, ::std::forward<T>(v))))
+{
+  return set_result(L, ::std::forward<T>(v));
+}
+
+// views keep the instance they were produced from in their uservalue
+template <::std::size_t O, typename T>
+inline typename ::std::enable_if<
+  is_view<typename ::std::decay<T>::type>{},
+  int>::type
+set_member_result(lua_State* const L, T&& v)
+{
+  auto const n(set_result(L, ::std::forward<T>(v)));
+
+  auto const i(1 == O ? lua_upvalueindex(2) : 1);
+
+  if (LUA_TUSERDATA == lua_type(L, i))
+  {
+#if LUA_VERSION_NUM >= 503
+    lua_pushvalue(L, i);
+#else
+    // uservalues must be tables
+    lua_createtable(L, 1, 0);
+    lua_pushvalue(L, i);
+    lua_rawseti(L, -2, 1);
+#endif // LUA_VERSION_NUM
+
+    lua_setuservalue(L, -2);
+  }
+  // else do nothing
+
+  return n;
+}
+
+template <::std::size_t O, typename C, typename R, typename ...A,
+  ::std::size_t ...I>
+inline typename ::std::enable_if<bool(!sizeof...(A)), R>::type
+forward(lua_State* const, C* const c,
+  R (C::* const ptr_to_member)(A...) const, indices<I...> const)
+  noexcept(noexcept((c->*ptr_to_member)()))
+{
+  return (c->*ptr_to_member)();
+}
+
+template <::std::size_t O, typename C, typename R, typename ...A,
+  ::std::size_t ...I>
+inline typename ::std::enable_if<bool(sizeof...(A)), R>::type
+forward(lua_State* const L, C* const c,
+  R (C::* const ptr_to_member)(A...) const, indices<I...> const)
+  noexcept(noexcept((c->*ptr_to_member)(get_arg<I + O, A>(L)...)))
+{
+  return scratch_call<A...>(L, [&]() -> R
+    {
+      return (c->*ptr_to_member)(get_arg<I + O, A>(L)...);
+    }
+  );
+}
+
+template <::std::size_t O, typename C, typename R, typename ...A,
+  ::std::size_t ...I>
+inline typename ::std::enable_if<bool(!sizeof...(A)), R>::type
+forward(lua_State* const, C* const c,
+  R (C::* const ptr_to_member)(A...), indices<I...> const)
+  noexcept(noexcept((c->*ptr_to_member)()))
+{
+  return (c->*ptr_to_member)();
+}
+
+template <::std::size_t O, typename C, typename R,
+  typename ...A, ::std::size_t ...I>
+inline typename ::std::enable_if<bool(sizeof...(A)), R>::type
+forward(lua_State* const L, C* const c,
+  R (C::* const ptr_to_member)(A...), indices<I...> const)
+  noexcept(noexcept((c->*ptr_to_member)(get_arg<I + O, A>(L)...)))
+{
+  return scratch_call<A...>(L, [&]() -> R
+    {
+      return (c->*ptr_to_member)(get_arg<I + O, A>(L)...);
+    }
+  );
+}
+
+template <typename FP, FP fp, ::std::size_t O, class C, class R, class ...A>
+typename ::std::enable_if<!::std::is_void<R>{}, int>::type
+member_stub(lua_State* const L)
+  noexcept(noexcept(set_member_result<O>(L,
+    forward<O, C, R, A...>(L,
+      static_cast<C*>(self<O>(L)),
+      fp,
+      make_indices<sizeof...(A)>()))))
+{
+//::std::cout << lua_gettop(L) << " " << sizeof...(A) + O - 1 << ::std::endl;
+  assert(sizeof...(A) + O - 1 == lua_gettop(L));
+
+  return set_member_result<O>(L,
+    forward<O, C, R, A...>(L,
+      static_cast<C*>(self<O>(L)),
+      fp,
+      make_indices<sizeof...(A)>()));
+}
+
+template <typename FP, FP fp, ::std::size_t O, class C, class R, class ...A>
+typename ::std::enable_if<::std::is_void<R>{}, int>::type
+member_stub(lua_State* const L)
+  noexcept(noexcept(forward<O, C, R, A...>(L,
+    static_cast<C*>(self<O>(L)),
+    fp,
+    make_indices<sizeof...(A)>())))
+{
+  assert(sizeof...(A) + O - 1 == lua_gettop(L));
+
+  forward<O, C, R, A...>(L,
+    static_cast<C*>(self<O>(L)),
+    fp,
+    make_indices<sizeof...(A)>());
+
+  return {};
+}
+
+template <typename FP, FP fp, class C, class R>
+typename ::std::enable_if<!::std::is_void<R>{}, int>::type
+vararg_member_stub(lua_State* const L)
+  noexcept(noexcept(set_member_result<2>(L,
+    (static_cast<C*>(self<2>(L))->*fp)(L))))
+{
+//::std::cout << lua_gettop(L) << ::std::endl;
+  return set_member_result<2>(L,
+    (static_cast<C*>(self<2>(L))->*fp)(L));
+}
+
+template <typename FP, FP fp, class C, class R>
+typename ::std::enable_if<::std::is_void<R>{}, int>::type
+vararg_member_stub(lua_State* const L)
+  noexcept(noexcept(
+    (static_cast<C*>(self<2>(L))->*fp)(L)))
+{
+//::std::cout << lua_gettop(L) << ::std::endl;
+  (static_cast<C*>(self<2>(L))->*fp)(L);
+
+  return {};
+}
+
+template <typename MP, MP mp, class C, class T>
+int field_getter_stub(lua_State* const L)
+  noexcept(noexcept(set_member_result<3>(L,
+    as_const(::std::declval<C&>().*mp))))
+{
+  assert(2 == lua_gettop(L));
+
+  return set_member_result<3>(L,
+    as_const(static_cast<C*>(self<3>(L))->*mp));
+}
+
+template <typename MP, MP mp, class C, class T>
+int field_setter_stub(lua_State* const L)
+  noexcept(noexcept(::std::declval<C&>().*mp = get_arg<3, T>(L)))
+{
+  assert(3 == lua_gettop(L));
+
+  static_cast<C*>(self<3>(L))->*mp = get_arg<3, T>(L);
+
+  return {};
+}
+
+// static accessors are called by getter() and setter() with an instance of
+// their own class, they never cast, see cast_property()
+inline void* static_self(lua_State* const L) noexcept
+{
+  assert(lua_isuserdata(L, 1));
+  return static_cast<object_header*>(lua_touserdata(L, 1))->instance;
+}
+
+template <typename FP, FP fp, class C, class R, class ...A>
+typename ::std::enable_if<!::std::is_void<R>{}, int>::type
+static_member_stub(lua_State* const L)
+  noexcept(noexcept(set_member_result<3>(L,
+    forward<3, C, R, A...>(L,
+      static_cast<C*>(static_self(L)),
+      fp,
+      make_indices<sizeof...(A)>()))))
+{
+  assert(sizeof...(A) + 2 == lua_gettop(L));
+
+  return set_member_result<3>(L,
+    forward<3, C, R, A...>(L,
+      static_cast<C*>(static_self(L)),
+      fp,
+      make_indices<sizeof...(A)>()));
+}
+
+template <typename FP, FP fp, class C, class R, class ...A>
+typename ::std::enable_if<::std::is_void<R>{}, int>::type
+static_member_stub(lua_State* const L)
+  noexcept(noexcept(forward<3, C, R, A...>(L,
+    static_cast<C*>(static_self(L)),
+    fp,
+    make_indices<sizeof...(A)>())))
+{
+  assert(sizeof...(A) + 2 == lua_gettop(L));
+
+  forward<3, C, R, A...>(L,
+    static_cast<C*>(static_self(L)),
+    fp,
+    make_indices<sizeof...(A)>());
+
+  return {};
+}
+
+template <typename MP, MP mp, class C, class T>
+int static_field_getter_stub(lua_State* const L)
+  noexcept(noexcept(set_member_result<3>(L,
+    as_const(::std::declval<C&>().*mp))))
+{
+  assert(2 == lua_gettop(L));
+
+  return set_member_result<3>(L,
+    as_const(static_cast<C*>(static_self(L))->*mp));
+}
+
+template <typename MP, MP mp, class C, class T>
+int static_field_setter_stub(lua_State* const L)
+  noexcept(noexcept(::std::declval<C&>().*mp = get_arg<3, T>(L)))
+{
+  assert(3 == lua_gettop(L));
+
+  static_cast<C*>(static_self(L))->*mp = get_arg<3, T>(L);
+
+  return {};
+}
+
+template <typename MP, MP mp, typename = MP>
+struct field_stubs_of;
+
+template <typename MP, MP mp, class C, class T>
+struct field_stubs_of<MP, mp, T C::*>
+{
+  static constexpr lua_CFunction getter() noexcept
+  {
+    return &field_getter_stub<MP, mp, C, T>;
+  }
+
+  static constexpr lua_CFunction setter() noexcept
+  {
+    return &field_setter_stub<MP, mp, C, T>;
+  }
+
+  static constexpr lua_CFunction static_getter() noexcept
+  {
+    return &static_field_getter_stub<MP, mp, C, T>;
+  }
+
+  static constexpr lua_CFunction static_setter() noexcept
+  {
+    return &static_field_setter_stub<MP, mp, C, T>;
+  }
+};
+
+template <typename FP, FP fp, typename = FP>
+struct static_stub_of;
+
+template <typename FP, FP fp, class C, class R, class ...A>
+struct static_stub_of<FP, fp, R (C::*)(A...) const>
+{
+  static constexpr lua_CFunction get() noexcept
+  {
+    return &static_member_stub<FP, fp, C, R, A...>;
+  }
+};
+
+template <typename FP, FP fp, class C, class R, class ...A>
+struct static_stub_of<FP, fp, R (C::*)(A...)>
+{
+  static constexpr lua_CFunction get() noexcept
+  {
+    return &static_member_stub<FP, fp, C, R, A...>;
+  }
+};
+
+inline constexpr bool str_equal(char const* const s1, char const* const s2)
+  noexcept
+{
+  return *s1 == *s2 && (!*s1 || str_equal(s1 + 1, s2 + 1));
+}
+
+inline constexpr bool unique_property(property_info const* const first,
+  property_info const* const last, char const* const name) noexcept
+{
+  return first == last ||
+    (!str_equal(first->name, name) &&
+    unique_property(first + 1, last, name));
+}
+
+inline constexpr bool unique_properties(property_info const* const first,
+  property_info const* const last) noexcept
+{
+  return first == last ||
+    (unique_property(first + 1, last, first->name) &&
+    unique_properties(first + 1, last));
+}
+
+// Lua type an argument must have to select an overload, LUA_TNONE matches
+// any type
+template <typename T, typename = void>
+struct type_tag : ::std::integral_constant<int, LUA_TNONE>
+{
+};
+
+template <typename T>
+struct type_tag<T, typename ::std::enable_if<
+  ::std::is_same<typename ::std::decay<T>::type, bool>{}>::type> :
+  ::std::integral_constant<int, LUA_TBOOLEAN>
+{
+};
+
+template <typename T>
+struct type_tag<T, typename ::std::enable_if<
+  ::std::is_arithmetic<typename ::std::decay<T>::type>{} &&
+  !::std::is_same<typename ::std::decay<T>::type, bool>{} &&
+  !is_nc_reference<T>{}>::type> :
+  ::std::integral_constant<int, LUA_TNUMBER>
+{
+};
+
+template <typename T>
+struct type_tag<T, typename ::std::enable_if<
+  ::std::is_same<typename ::std::decay<T>::type, char const*>{} ||
+  is_string_ref<typename ::std::decay<T>::type>{}>::type> :
+  ::std::integral_constant<int, LUA_TSTRING>
+{
+};
+
+template <typename T>
+struct type_tag<T, typename ::std::enable_if<
+  (::std::is_pointer<T>{} &&
+  !::std::is_same<typename ::std::decay<T>::type, char const*>{}) ||
+  (is_nc_reference<T>{} &&
+  !::std::is_class<typename ::std::decay<T>::type>{})>::type> :
+  ::std::integral_constant<int, LUA_TLIGHTUSERDATA>
+{
+};
+
+template <typename T>
+struct type_tag<T, typename ::std::enable_if<
+  has_fields<typename ::std::decay<T>::type>{}
+#ifndef LUALITE_NO_STD_CONTAINERS
+  || is_columns<typename ::std::decay<T>::type>{}
+#endif // LUALITE_NO_STD_CONTAINERS
+  >::type> :
+  ::std::integral_constant<int, LUA_TTABLE>
+{
+};
+
+#ifndef LUALITE_NO_STD_CONTAINERS
+
+template <typename T>
+struct type_tag<T, typename ::std::enable_if<
+  ::std::is_same<typename ::std::decay<T>::type, ::std::string>{}>::type> :
+  ::std::integral_constant<int, LUA_TSTRING>
+{
+};
+
+template <typename T>
+struct type_tag<T, typename ::std::enable_if<
+  is_std_array<typename ::std::decay<T>::type>{} ||
+  is_std_deque<typename ::std::decay<T>::type>{} ||
+  is_std_forward_list<typename ::std::decay<T>::type>{} ||
+  is_std_list<typename ::std::decay<T>::type>{} ||
+  is_std_map<typename ::std::decay<T>::type>{} ||
+  is_std_pair<typename ::std::decay<T>::type>{} ||
+  is_std_set<typename ::std::decay<T>::type>{} ||
+  is_std_tuple<typename ::std::decay<T>::type>{} ||
+  is_std_unordered_map<typename ::std::decay<T>::type>{} ||
+  is_std_unordered_set<typename ::std::decay<T>::type>{} ||
+  is_std_vector<typename ::std::decay<T>::type>{}>::type> :
+  ::std::integral_constant<int, LUA_TTABLE>
+{
+};
+
+template <typename T>
+struct type_tag<T, typename ::std::enable_if<
+  is_reused<typename ::std::decay<T>::type>{}>::type> :
+  type_tag<typename ::std::decay<T>::type::value_type>
+{
+};
+
+#endif // LUALITE_NO_STD_CONTAINERS
+
+template <int I>
+inline bool match_args(lua_State* const) noexcept
+{
+  return true;
+}
+
+template <int I, class A, class ...B>
+inline bool match_args(lua_State* const L) noexcept
+{
+  return ((LUA_TNONE == type_tag<A>{}) || (type_tag<A>{} == lua_type(L, I)))
+    && match_args<I + 1, B...>(L);
+}
+
+#ifndef LUALITE_NO_STD_CONTAINERS
+
+template <class C>
+inline C const& viewed(lua_State* const L) noexcept
+{
+  assert(lua_isuserdata(L, 1));
+  return **static_cast<C const**>(lua_touserdata(L, 1));
+}
+
+// the iterator returned by pairs() is reachable from scripts
+template <class C>
+inline C const& checked_viewed(lua_State* const L)
+{
+  if (checked)
+  {
+    check_metatable(L, &class_tag<view<C> >::key, "view expected");
+  }
+  // else do nothing
+
+  return viewed<C>(L);
+}
+
+// floats without an exact integer value are no integer keys
+inline bool integer_key(lua_State* const L, lua_Integer& i) noexcept
+{
+  int isnum;
+
+  i = lua_tointegerx(L, 2, &isnum);
+
+#if LUA_VERSION_NUM < 503
+  // lua_tointegerx() truncates
+  isnum = isnum && (lua_Number(i) == lua_tonumber(L, 2));
+#endif // LUA_VERSION_NUM
+
+  return isnum;
+}
+
+template <typename K>
+inline typename ::std::enable_if<
+  ::std::is_integral<K>{} && !::std::is_same<K, bool>{},
+  bool>::type
+exact_key(lua_State* const L) noexcept
+{
+  lua_Integer i;
+
+  return integer_key(L, i);
+}
+
+template <typename K>
+inline typename ::std::enable_if<
+  !::std::is_integral<K>{} || ::std::is_same<K, bool>{},
+  bool>::type
+exact_key(lua_State* const) noexcept
+{
+  return true;
+}
+
+template <class C, typename = void>
+struct view_stubs
+{
+  static_assert(sizeof(C) && false, "unsupported container");
+};
+
+template <class C>
+struct view_stubs<C, typename ::std::enable_if<
+  is_std_array<C>{} || is_std_deque<C>{} || is_std_vector<C>{}>::type>
+{
+  static int index(lua_State* const L)
+  {
+    auto& c(viewed<C>(L));
+
+    lua_Integer i;
+
+    if (integer_key(L, i) && (i > 0) && (::std::size_t(i) <= c.size()))
+    {
+      return set_result(L, c[i - 1]);
+    }
+    else
+    {
+      lua_pushnil(L);
+
+      return 1;
+    }
+  }
+
+  static int next(lua_State* const L)
+  {
+    auto& c(checked_viewed<C>(L));
+
+    auto const i(lua_tointeger(L, 2));
+
+    if (::std::size_t(i) < c.size())
+    {
+      lua_pushinteger(L, i + 1);
+
+      return 1 + set_result(L, c[i]);
+    }
+    else
+    {
+      return {};
+    }
+  }
+
+  static int pairs(lua_State* const L)
+  {
+    lua_pushcfunction(L, next);
+    lua_pushvalue(L, 1);
+    lua_pushinteger(L, 0);
+
+    return 3;
+  }
+};
+
+template <class C>
+struct view_stubs<C, typename ::std::enable_if<
+  is_std_map<C>{} || is_std_unordered_map<C>{}>::type>
+{
+  using key_type = typename C::key_type;
+
+  static int index(lua_State* const L)
+  {
+    auto& c(viewed<C>(L));
+
+    if (match_args<2, key_type>(L) && exact_key<key_type>(L))
+    {
+      auto const i(c.find(get_arg<2, key_type>(L)));
+
+      if (c.cend() != i)
+      {
+        return set_result(L, i->second);
+      }
+      // else do nothing
+    }
+    // else do nothing
+
+    lua_pushnil(L);
+
+    return 1;
+  }
+
+  // the previous key is looked up again
+  static int next(lua_State* const L)
+  {
+    auto& c(checked_viewed<C>(L));
+
+    auto i(c.cbegin());
+
+    if (!lua_isnil(L, 2))
+    {
+      i = c.find(get_arg<2, key_type>(L));
+
+      if (c.cend() != i)
+      {
+        ++i;
+      }
+      // else do nothing
+    }
+    // else do nothing
+
+    if (c.cend() == i)
+    {
+      return {};
+    }
+    else
+    {
+      // the key goes below the value
+      set_result(L, i->first);
+      set_result(L, i->second);
+
+      return 2;
+    }
+  }
+
+  static int pairs(lua_State* const L)
+  {
+    lua_pushcfunction(L, next);
+    lua_pushvalue(L, 1);
+    lua_pushnil(L);
+
+    return 3;
+  }
+};
+
+template <class C>
+int view_len(lua_State* const L) noexcept
+{
+  lua_pushinteger(L, viewed<C>(L).size());
+
+  return 1;
+}
+
+// views of C in a lua_State share a single metatable
+template <class C>
+void push_view_metatable(lua_State* const L)
+{
+  auto const key(&class_tag<view<C> >::key);
+
+  lua_rawgetp(L, LUA_REGISTRYINDEX, key);
+
+  if (lua_isnil(L, -1))
+  {
+    lua_pop(L, 1);
+
+    lua_createtable(L, 0, 4);
+
+    lua_pushcfunction(L, view_stubs<C>::index);
+    rawsetfield(L, -2, "__index");
+
+    lua_pushcfunction(L, view_len<C>);
+    rawsetfield(L, -2, "__len");
+
+    lua_pushcfunction(L, view_stubs<C>::pairs);
+    rawsetfield(L, -2, "__pairs");
+
+    lua_pushcfunction(L, view_stubs<C>::pairs);
+    rawsetfield(L, -2, "__ipairs");
+
+    protect_metatable(L);
+
+    lua_pushvalue(L, -1);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, key);
+  }
+  // else do nothing
+}
+
+#endif // LUALITE_NO_STD_CONTAINERS
+
+template <::std::size_t O, class, class = void>
+struct overload_candidate;
+
+template <::std::size_t O, class C, class R, class ...A,
+  R (C::*fp)(A...) const>
+struct overload_candidate<O, overload<R (C::*)(A...) const, fp> >
+{
+  static constexpr int arity() noexcept { return sizeof...(A); }
+
+  static bool match(lua_State* const L) noexcept
+  {
+    return match_args<O, A...>(L);
+  }
+
+  static int call(lua_State* const L)
+  {
+    return member_stub<R (C::*)(A...) const, fp, O, C, R, A...>(L);
+  }
+};
+
+template <::std::size_t O, class C, class R, class ...A,
+  R (C::*fp)(A...)>
+struct overload_candidate<O, overload<R (C::*)(A...), fp> >
+{
+  static constexpr int arity() noexcept { return sizeof...(A); }
+
+  static bool match(lua_State* const L) noexcept
+  {
+    return match_args<O, A...>(L);
+  }
+
+  static int call(lua_State* const L)
+  {
+    return member_stub<R (C::*)(A...), fp, O, C, R, A...>(L);
+  }
+};
+
+template <::std::size_t O, class R, class ...A, R (*fp)(A...)>
+struct overload_candidate<O, overload<R (*)(A...), fp> >
+{
+  static constexpr int arity() noexcept { return sizeof...(A); }
+
+  static bool match(lua_State* const L) noexcept
+  {
+    return match_args<O, A...>(L);
+  }
+
+  static int call(lua_State* const L)
+  {
+    return func_stub<R (*)(A...), fp, O, R, A...>(L);
+  }
+};
+
+// constructor signatures, the return type is ignored
+template <::std::size_t O, class C, class R, class ...A>
+struct overload_candidate<O, R (A...), C>
+{
+  static constexpr int arity() noexcept { return sizeof...(A); }
+
+  static bool match(lua_State* const L) noexcept
+  {
+    return match_args<O, A...>(L);
+  }
+
+  static int call(lua_State* const L)
+  {
+    return constructor_stub<O, C, A...>(L);
+  }
+};
+
+template <class ...>
+struct dispatcher;
+
+template <>
+struct dispatcher<>
+{
+  static int call(lua_State* const L, int const)
+  {
+    return luaL_error(L, "no matching overload");
+  }
+};
+
+template <class T, class ...U>
+struct dispatcher<T, U...>
+{
+  static int call(lua_State* const L, int const n)
+  {
+    return (T::arity() == n) && T::match(L) ?
+      T::call(L) :
+      dispatcher<U...>::call(L, n);
+  }
+};
+
+// overloads are tried in order, by argument count first, then by type
+template <::std::size_t O, class ...T>
+int overload_stub(lua_State* const L)
+{
+  return dispatcher<T...>::call(L, lua_gettop(L) - int(O - 1));
+}
+
+// pushes the arguments in order, returns how many values they became
+template <typename ...A>
+inline int push_args(lua_State* const L, A&& ...args)
+  noexcept(noexcept(swallow{(set_result(L, ::std::forward<A>(args)))...}))
+{
+  // the elements of a braced list are evaluated in sequence
+  int const n[]{0, set_result(L, ::std::forward<A>(args))...};
+
+  int ac{};
+
+  for (auto const i: n)
+  {
+    ac += i;
+  }
+
+  return ac;
+}
+
+template <typename ...A>
+inline void call(lua_State* const L, int const nresults, A&& ...args)
+  noexcept(noexcept(push_args(L, ::std::forward<A>(args)...)))
+{
+  auto const ac(push_args(L, ::std::forward<A>(args)...));
+  assert(decltype(sizeof...(A))(ac) <= sizeof...(A));
+
+  lua_call(L, ac, nresults);
+}
+
+template <typename R>
+inline typename ::std::enable_if<::std::is_void<R>{}>::type
+pop_result(lua_State* const) noexcept
+{
+}
+
+// the result must not refer to the popped value
+template <typename R>
+inline typename ::std::enable_if<!::std::is_void<R>{}, R>::type
+pop_result(lua_State* const L)
+{
+  static_assert(!::std::is_pointer<R>{} && !is_string_ref<R>{},
+    "the result would outlive the value it refers to");
+
+  R r(get_arg<-1, R>(L));
+
+  lua_pop(L, 1);
+
+  return r;
+}
+
+// runs only on failure, the traceback is not built otherwise
+inline int message_handler(lua_State* const L)
+{
+  if (auto const msg = lua_tostring(L, 1))
+  {
+    luaL_traceback(L, L, msg, 1);
+  }
+  else if (!luaL_callmeta(L, 1, "__tostring") ||
+    (LUA_TSTRING != lua_type(L, -1)))
+  {
+    lua_pushfstring(L, "(error object is a %s value)", luaL_typename(L, 1));
+  }
+  // else do nothing
+
+  return 1;
+}
+
+template <typename R>
+inline typename ::std::enable_if<::std::is_void<R>{}, call_result<R> >::type
+make_call_result(lua_State* const, int const status) noexcept
+{
+  return {status};
+}
+
+template <typename R>
+inline typename ::std::enable_if<!::std::is_void<R>{}, call_result<R> >::type
+make_call_result(lua_State* const L, int const status)
+{
+  return LUA_OK == status ?
+    call_result<R>{status, pop_result<R>(L)} :
+    call_result<R>{status, R()};
+}
+
+// the message handler is at h, the function is right above it
+template <typename R, typename ...A>
+inline call_result<R> pcall(lua_State* const L, int const h, A&& ...args)
+{
+  auto const ac(push_args(L, ::std::forward<A>(args)...));
+
+  auto const status(lua_pcall(L, ac, ::std::is_void<R>{} ? 0 : 1, h));
+
+  // the message or the result are above the handler
+  lua_remove(L, h);
+
+  return make_call_result<R>(L, status);
+}
+
+} // detail
+
+template <typename ...A>
+inline void call(lua_State* const L, int const nresults, A&& ...args)
+  noexcept(noexcept(detail::call(L, nresults, ::std::forward<A>(args)...)))
+{
+  detail::call(L, nresults, ::std::forward<A>(args)...);
+}
+
+// the function is at the top of the stack, errors do not unwind through
+// the caller, e.g. if (auto const r = pcall<int>(L, 1)) { r.value; }
+template <typename R, typename ...A>
+inline call_result<R> pcall(lua_State* const L, A&& ...args)
+{
+  // light C functions are pushed without allocating
+  lua_pushcfunction(L, detail::message_handler);
+  lua_insert(L, -2);
+
+  return detail::pcall<R>(L, lua_gettop(L) - 1, ::std::forward<A>(args)...);
+}
+
+template <typename> class function_ref;
+
+// a Lua function pinned in the registry, calls push it by reference
+// instead of looking it up by name, e.g.
+// function_ref<int(int, int)> const f(L, "add"); f(1, 2);
+template <typename R, typename ...A>
+class function_ref<R (A...)>
+{
+public:
+  function_ref() = default;
+
+  function_ref(lua_State* const L, int const index) :
+    L_(L)
+  {
+    lua_pushvalue(L, index);
+    assert(lua_isfunction(L, -1));
+
+    ref_ = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+
+  function_ref(lua_State* const L, char const* const name) :
+    L_(L)
+  {
+    lua_getglobal(L, name);
+    assert(lua_isfunction(L, -1));
+
+    ref_ = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+
+  function_ref(function_ref const&) = delete;
+
+  function_ref(function_ref&& other) noexcept :
+    L_(other.L_),
+    ref_(other.ref_)
+  {
+    other.L_ = {};
+    other.ref_ = LUA_NOREF;
+  }
+
+  // registry slots are recycled by luaL_unref()
+  ~function_ref()
+  {
+    if (L_)
+    {
+      luaL_unref(L_, LUA_REGISTRYINDEX, ref_);
+    }
+    // else do nothing
+  }
+
+  function_ref& operator=(function_ref const&) = delete;
+
+  function_ref& operator=(function_ref&& other) noexcept
+  {
+    if (this != &other)
+    {
+      this->~function_ref();
+
+      L_ = other.L_;
+      ref_ = other.ref_;
+
+      other.L_ = {};
+      other.ref_ = LUA_NOREF;
+    }
+    // else do nothing
+
+    return *this;
+  }
+
+  explicit operator bool() const noexcept
+  {
+    return L_ && (ref_ >= 0);
+  }
+
+  // errors propagate as with lua_call()
+  R operator()(A ...args) const
+  {
+    assert(*this);
+
+    lua_rawgeti(L_, LUA_REGISTRYINDEX, ref_);
+
+    detail::call(L_, ::std::is_void<R>{} ? 0 : 1,
+      ::std::forward<A>(args)...);
+
+    return detail::pop_result<R>(L_);
+  }
+
+  call_result<R> pcall(A ...args) const
+  {
+    assert(*this);
+
+    lua_pushcfunction(L_, detail::message_handler);
+
+    auto const h(lua_gettop(L_));
+
+    lua_rawgeti(L_, LUA_REGISTRYINDEX, ref_);
+
+    return detail::pcall<R>(L_, h, ::std::forward<A>(args)...);
+  }
+
+  void push() const
+  {
+    lua_rawgeti(L_, LUA_REGISTRYINDEX, ref_);
+  }
+
+  lua_State* state() const noexcept
+  {
+    return L_;
+  }
+
+private:
+  lua_State* L_{};
+
+  int ref_{LUA_NOREF};
+};
+
+// events accumulate on the C++ side and are handed over in a single call
+// to handler(t, n), t is an array table reused from flush to flush, events
+// pushed as several values are packed into arrays of their own, a view
+// of events() avoids the copy for containers view supports
+template <typename T>
+class batch
+{
+public:
+  using size_type = typename ::std::vector<T>::size_type;
+
+  // the handler is at index
+  batch(lua_State* const L, int const index, size_type const n = {}) :
+    L_(L)
+  {
+    lua_pushvalue(L, index);
+    assert(lua_isfunction(L, -1));
+
+    handler_ = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    lua_createtable(L, n, 0);
+
+    table_ = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    events_.reserve(n);
+  }
+
+  batch(batch const&) = delete;
+
+  ~batch()
+  {
+    luaL_unref(L_, LUA_REGISTRYINDEX, table_);
+    luaL_unref(L_, LUA_REGISTRYINDEX, handler_);
+  }
+
+  batch& operator=(batch const&) = delete;
+
+  void push(T const& e) { events_.push_back(e); }
+
+  void push(T&& e) { events_.push_back(::std::move(e)); }
+
+  template <typename ...A>
+  void emplace(A&& ...args)
+  {
+    events_.emplace_back(::std::forward<A>(args)...);
+  }
+
+  bool empty() const noexcept { return events_.empty(); }
+
+  size_type size() const noexcept { return events_.size(); }
+
+  ::std::vector<T> const& events() const noexcept { return events_; }
+
+  // events pushed by the handler go into the next batch
+  call_result<void> flush()
+  {
+    if (events_.empty())
+    {
+      return {LUA_OK};
+    }
+    // else do nothing
+
+    lua_pushcfunction(L_, detail::message_handler);
+
+    auto const h(lua_gettop(L_));
+
+    lua_rawgeti(L_, LUA_REGISTRYINDEX, handler_);
+    lua_rawgeti(L_, LUA_REGISTRYINDEX, table_);
+
+    auto const n(events_.size());
+
+    auto const t(lua_gettop(L_));
+
+    for (size_type i{}; i != n; ++i)
+    {
+      // events pushed as several values, e.g. pairs, become arrays
+      if (auto const m = detail::set_result(L_,
+        detail::as_const(events_[i])) - 1)
+      {
+        lua_createtable(L_, m + 1, 0);
+        lua_insert(L_, -m - 2);
+
+        for (auto j(m + 1); j; --j)
+        {
+          lua_rawseti(L_, t + 1, j);
+        }
+      }
+      // else do nothing
+
+      lua_rawseti(L_, t, i + 1);
+    }
+
+    // clear what is left of a longer batch, the array part is kept
+    for (auto i(n); i < size_; ++i)
+    {
+      lua_pushnil(L_);
+      lua_rawseti(L_, -2, i + 1);
+    }
+
+    size_ = n;
+
+    events_.clear();
+
+    auto const status(lua_pcall(L_, 1 + detail::push_args(L_, n), 0, h));
+
+    lua_remove(L_, h);
+
+    return {status};
+  }
+
+private:
+  lua_State* const L_;
+
+  int handler_;
+
+  int table_;
+
+  // length of the table
+  size_type size_{};
+
+  ::std::vector<T> events_;
+};
+
+// runs coroutines on one thread, a coroutine runs until it finishes,
+// yields, or suspends in a bound function waiting for a timer or an event,
+// e.g. .vararg_def<LLFUNC(scheduler::sleep)>("sleep")
+class scheduler
+{
+public:
+  using clock = ::std::chrono::steady_clock;
+
+  // called with a coroutine that failed, its message at the top
+  using error_handler = void (*)(lua_State*, int);
+
+  explicit scheduler(lua_State* const L,
+    error_handler const on_error = nullptr) :
+    L_(L),
+    on_error_(on_error)
+  {
+    lua_pushlightuserdata(L, this);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &detail::class_tag<scheduler>::key);
+  }
+
+  scheduler(scheduler const&) = delete;
+
+  ~scheduler()
+  {
+    for (auto& t: tasks_)
+    {
+      luaL_unref(L_, LUA_REGISTRYINDEX, t.second);
+    }
+
+    lua_pushnil(L_);
+    lua_rawsetp(L_, LUA_REGISTRYINDEX, &detail::class_tag<scheduler>::key);
+  }
+
+  scheduler& operator=(scheduler const&) = delete;
+
+  static scheduler& get(lua_State* const L)
+  {
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &detail::class_tag<scheduler>::key);
+
+    auto const s(static_cast<scheduler*>(lua_touserdata(L, -1)));
+
+    lua_pop(L, 1);
+
+    if (!s)
+    {
+      luaL_error(L, "no scheduler for this lua_State");
+    }
+    // else do nothing
+
+    return *s;
+  }
+
+  // sleep(seconds) for Lua
+  static suspend<> sleep(lua_State* const L)
+  {
+    return get(L).sleep_for(L,
+      ::std::chrono::duration_cast<clock::duration>(
+        ::std::chrono::duration<lua_Number>(luaL_checknumber(L, 1))));
+  }
+
+  // the function and its nargs arguments are at the top of L, the new
+  // coroutine runs with the next run_once()
+  lua_State* spawn(lua_State* const L, int const nargs)
+  {
+    auto const co(lua_newthread(L));
+
+    tasks_.emplace(co, luaL_ref(L, LUA_REGISTRYINDEX));
+
+    lua_xmove(L, co, nargs + 1);
+
+    ready_.push_back(co);
+
+    return co;
+  }
+
+  suspend<> sleep_for(lua_State* const co, clock::duration const d)
+  {
+    check(co);
+
+    timers_.push_back({clock::now() + d, co});
+    ::std::push_heap(timers_.begin(), timers_.end(), later);
+
+    suspended_ = true;
+
+    return {0};
+  }
+
+  suspend<> wait(lua_State* const co, void const* const event)
+  {
+    check(co);
+
+    waiting_.emplace(event, co);
+
+    suspended_ = true;
+
+    return {0};
+  }
+
+  // coroutines waiting for the event run with the next run_once()
+  void notify(void const* const event)
+  {
+    auto const r(waiting_.equal_range(event));
+
+    for (auto i(r.first); i != r.second; ++i)
+    {
+      ready_.push_back(i->second);
+    }
+
+    waiting_.erase(r.first, r.second);
+  }
+
+  ::std::size_t size() const noexcept
+  {
+    return tasks_.size();
+  }
+
+  bool idle() const noexcept
+  {
+    return ready_.empty();
+  }
+
+  // the time the earliest timer expires, if there is one
+  bool next_timer(clock::time_point& t) const noexcept
+  {
+    return timers_.empty() ? false : (t = timers_.front().when, true);
+  }
+
+  // resumes coroutines that are ready or whose timers expired by now
+  void run_once(clock::time_point const now = clock::now())
+  {
+    while (!timers_.empty() && (timers_.front().when <= now))
+    {
+      ::std::pop_heap(timers_.begin(), timers_.end(), later);
+
+      ready_.push_back(timers_.back().co);
+      timers_.pop_back();
+    }
+
+    // coroutines made ready from here on run the next time
+    running_.swap(ready_);
+
+    for (auto const co: running_)
+    {
+      resume(co);
+    }
+
+    running_.clear();
+  }
+
+  // returns when all coroutines finished or wait for events
+  void run()
+  {
+    for (clock::time_point t; !tasks_.empty();)
+    {
+      run_once();
+
+      if (ready_.empty())
+      {
+        if (next_timer(t))
+        {
+          ::std::this_thread::sleep_until(t);
+        }
+        else
+        {
+          break;
+        }
+      }
+      // else do nothing
+    }
+  }
+
+private:
+  friend class worker_pool;
+
+  struct timer
+  {
+    clock::time_point when;
+
+    lua_State* co;
+  };
+
+  static bool later(timer const& a, timer const& b) noexcept
+  {
+    return a.when > b.when;
+  }
+
+  // raises an error, before anything is registered, if co can not yield
+  void check(lua_State* const co) const
+  {
+    if (!tasks_.count(co))
+    {
+      luaL_error(co, "not a scheduled coroutine");
+    }
+#if LUA_VERSION_NUM >= 503
+    else if (!lua_isyieldable(co))
+    {
+      luaL_error(co, "attempt to yield across a C-call boundary");
+    }
+#endif // LUA_VERSION_NUM
+    // else do nothing
+  }
+
+  void resume(lua_State* const co)
+  {
+    // a stale timer or event of a finished coroutine
+    if (!tasks_.count(co))
+    {
+      return;
+    }
+    // else do nothing
+
+    // the yielded values were dropped, a new coroutine has its function
+    // below the arguments
+    auto const nargs(LUA_YIELD == lua_status(co) ? 0 : lua_gettop(co) - 1);
+
+    suspended_ = false;
+
+#if LUA_VERSION_NUM >= 504
+    int nres;
+
+    auto const status(lua_resume(co, L_, nargs, &nres));
+#else
+    auto const status(lua_resume(co, L_, nargs));
+
+    // the stack holds just the yielded values
+    auto const nres(lua_gettop(co));
+#endif // LUA_VERSION_NUM
+
+    if (LUA_YIELD == status)
+    {
+      // drop the yielded values, anything below them belongs to the frame
+      // that yielded
+      lua_pop(co, nres);
+
+      // a plain coroutine.yield() only gives up its turn
+      if (!suspended_)
+      {
+        ready_.push_back(co);
+      }
+      // else do nothing
+    }
+    else
+    {
+      if ((LUA_OK != status) && on_error_)
+      {
+        on_error_(co, status);
+      }
+      // else do nothing
+
+      // spawn() may have rehashed tasks_ meanwhile
+      auto const i(tasks_.find(co));
+
+      luaL_unref(L_, LUA_REGISTRYINDEX, i->second);
+
+      tasks_.erase(i);
+    }
+  }
+
+  lua_State* const L_;
+
+  error_handler const on_error_;
+
+  bool suspended_{};
+
+  // coroutines are anchored in the registry while they are scheduled
+  ::std::unordered_map<lua_State*, int> tasks_;
+
+  ::std::vector<lua_State*> ready_;
+  ::std::vector<lua_State*> running_;
+
+  // a heap, the earliest timer first
+  ::std::vector<timer> timers_;
+
+  ::std::unordered_multimap<void const*, lua_State*> waiting_;
+};
+
+// runs the bodies of functions bound with async_def() on worker threads,
+// while the calling coroutine of the scheduler waits, the arguments are
+// copied before the body runs, the results are pushed when it resumes
+class worker_pool
+{
+public:
+  explicit worker_pool(scheduler& s,
+    unsigned const n = ::std::thread::hardware_concurrency()) :
+    s_(s),
+    L_(s.L_)
+  {
+    for (auto i(n ? n : 1); i; --i)
+    {
+      threads_.emplace_back(&worker_pool::work_loop, this);
+    }
+
+    lua_pushlightuserdata(L_, this);
+    lua_rawsetp(L_, LUA_REGISTRYINDEX, &detail::class_tag<worker_pool>::key);
+  }
+
+  worker_pool(worker_pool const&) = delete;
+
+  // queued jobs are finished first, their coroutines are not resumed
+  ~worker_pool()
+  {
+    {
+      ::std::lock_guard<::std::mutex> const l(m_);
+
+      stop_ = true;
+    }
+
+    ready_.notify_all();
+
+    for (auto& t: threads_)
+    {
+      t.join();
+    }
+
+    for (auto w(done_); w;)
+    {
+      auto const next(w->next);
+
+      delete w;
+
+      w = next;
+    }
+
+    lua_pushnil(L_);
+    lua_rawsetp(L_, LUA_REGISTRYINDEX, &detail::class_tag<worker_pool>::key);
+  }
+
+  worker_pool& operator=(worker_pool const&) = delete;
+
+  static worker_pool& get(lua_State* const L)
+  {
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &detail::class_tag<worker_pool>::key);
+
+    auto const p(static_cast<worker_pool*>(lua_touserdata(L, -1)));
+
+    lua_pop(L, 1);
+
+    if (!p)
+    {
+      luaL_error(L, "no worker_pool for this lua_State");
+    }
+    // else do nothing
 
-  lua_rawgeti(L, -1, 1);
-  lua_rawgeti(L, -2, 2);
+    return *p;
+  }
 
-  result_type const result(
-    get_arg<-2, typename result_type::first_type>(L),
-    get_arg<-1, typename result_type::second_type>(L));
+  // jobs submitted, whose coroutines were not woken yet
+  ::std::size_t pending() const noexcept
+  {
+    return pending_;
+  }
 
-  lua_pop(L, 2);
+  // wakes the coroutines whose jobs finished, on the thread of the state
+  void poll()
+  {
+    work* w;
 
-  return result;
-}
+    {
+      ::std::lock_guard<::std::mutex> const l(m_);
 
-template <::std::size_t O, class C, ::std::size_t ...I>
-inline C get_tuple_arg(lua_State* const L, indices<I...> const)
-  noexcept(noexcept(::std::make_tuple(get_arg<int(I - sizeof...(I)),
-    typename ::std::tuple_element<I, C>::type>(L)...)))
-{
-  swallow{(lua_rawgeti(L, O, I + 1), 0)...};
+      w = done_;
+      done_ = {};
+    }
 
-  C result(::std::make_tuple(get_arg<int(I - sizeof...(I)),
-    typename ::std::tuple_element<I, C>::type>(L)...));
+    for (; w; w = w->next)
+    {
+      --pending_;
 
-  lua_pop(L, int(sizeof...(I)));
+      s_.notify(w->co);
+    }
+  }
 
-  return result;
-}
+  // runs the scheduler until its coroutines finish or wait for events
+  // other than jobs
+  void run()
+  {
+    for (scheduler::clock::time_point t;;)
+    {
+      s_.run_once();
 
-template <int I, class C>
-inline typename ::std::enable_if<
-  is_std_tuple<typename ::std::decay<C>::type>{} &&
-  !is_nc_reference<C>{},
-  typename ::std::decay<C>::type>::type
-get_arg(lua_State* const L)
-  noexcept(noexcept(get_tuple_arg<I, typename ::std::decay<C>::type>(L,
-    make_indices<::std::tuple_size<typename ::std::decay<C>::type>{}>())))
-{
-  assert(lua_istable(L, I));
+      poll();
 
-  using result_type = typename ::std::decay<C>::type;
+      if (s_.idle())
+      {
+        auto const timer(s_.next_timer(t));
 
-  return get_tuple_arg<I, result_type>(L,
-    make_indices<::std::tuple_size<result_type>{}>());
-}
+        if (pending_)
+        {
+          ::std::unique_lock<::std::mutex> l(m_);
 
-template<int I, class C>
-inline typename ::std::enable_if<
-  is_std_array<typename ::std::decay<C>::type>{} &&
-  !is_nc_reference<C>{},
-  typename ::std::decay<C>::type>::type
-get_arg(lua_State* const L)
-{
-  assert(lua_istable(L, I));
+          auto const finished([this]() noexcept { return bool(done_); });
 
-  using result_type = typename ::std::decay<C>::type;
-  result_type result;
+          timer ? done_cv_.wait_until(l, t, finished) :
+            (done_cv_.wait(l, finished), true);
+        }
+        else if (timer)
+        {
+          ::std::this_thread::sleep_until(t);
+        }
+        else
+        {
+          break;
+        }
+      }
+      // else do nothing
+    }
+  }
 
-  auto const end(::std::min(lua_rawlen(L, I), result.size()) + 1);
+private:
+  friend class module;
+  friend class scope;
 
-  for (decltype(lua_rawlen(L, I)) i(1); i != end; ++i)
+  struct work
   {
-    lua_rawgeti(L, I, i);
-
-    result[i - 1] = get_arg<-1, typename result_type::value_type>(L);
-  }
+    virtual ~work() = default;
 
-  lua_pop(L, end - 1);
+    virtual void run() noexcept = 0;
 
-  return result;
-}
+    virtual int push(lua_State*) = 0;
 
-template <int I, class C>
-inline typename ::std::enable_if<
-  is_std_deque<typename ::std::decay<C>::type>{} &&
-  !is_nc_reference<C>{},
-  typename ::std::decay<C>::type>::type
-get_arg(lua_State* const L)
-{
-  assert(lua_istable(L, I));
+    lua_State* co;
 
-  using result_type = typename ::std::decay<C>::type;
-  result_type result;
+    // the queue or the list of finished jobs
+    work* next;
 
-  auto const end(lua_rawlen(L, I) + 1);
+    ::std::exception_ptr error;
+  };
 
-  for (decltype(lua_rawlen(L, I)) i(1); i != end; ++i)
+  template <typename FP, FP fp, typename R, typename ...A>
+  struct job : work
   {
-    lua_rawgeti(L, I, i);
+    static_assert(!::std::is_reference<R>{} && !::std::is_pointer<R>{},
+      "results must not refer to memory of the worker");
 
-    result.emplace_back(get_arg<-1, typename result_type::value_type>(L));
-  }
+    using args_type = ::std::tuple<typename ::std::decay<A>::type...>;
 
-  lua_pop(L, end - 1);
+    using value_type = typename ::std::conditional<::std::is_void<R>{},
+      char, R>::type;
 
-  return result;
-}
+    explicit job(args_type&& a) : args(::std::move(a)) { }
 
-template <int I, class C>
-inline typename ::std::enable_if<
-  is_std_forward_list<typename ::std::decay<C>::type>{} &&
-  !is_nc_reference<C>{},
-  typename ::std::decay<C>::type>::type
-get_arg(lua_State* const L)
-{
-  assert(lua_istable(L, I));
+    ~job()
+    {
+      if (has_result)
+      {
+        reinterpret_cast<value_type*>(&result)->~value_type();
+      }
+      // else do nothing
+    }
 
-  using result_type = typename ::std::decay<C>::type;
-  result_type result;
+    void run() noexcept final
+    {
+      try
+      {
+        call(::std::is_void<R>{}, detail::make_indices<sizeof...(A)>());
+      }
+      catch (...)
+      {
+        error = ::std::current_exception();
+      }
+    }
 
-  auto const len(lua_rawlen(L, I));
+    int push(lua_State* const L) final
+    {
+      return push(L, ::std::is_void<R>{});
+    }
 
-  for (auto i(len); i; --i)
-  {
-    lua_rawgeti(L, I, i);
+    template <::std::size_t ...I>
+    void call(::std::true_type const, detail::indices<I...> const)
+    {
+      fp(::std::forward<A>(::std::get<I>(args))...);
+    }
 
-    result.emplace_front(get_arg<-1, typename result_type::value_type>(L));
-  }
+    template <::std::size_t ...I>
+    void call(::std::false_type const, detail::indices<I...> const)
+    {
+      ::new (&result) value_type(
+        fp(::std::forward<A>(::std::get<I>(args))...));
 
-  lua_pop(L, len);
+      has_result = true;
+    }
 
-  return result;
-}
+    int push(lua_State* const, ::std::true_type const) noexcept
+    {
+      return {};
+    }
 
-template <int I, class C>
-inline typename ::std::enable_if<
-  is_std_list<typename ::std::decay<C>::type>{} &&
-  !is_nc_reference<C>{},
-  typename ::std::decay<C>::type>::type
-get_arg(lua_State* const L)
-{
-  assert(lua_istable(L, I));
+    int push(lua_State* const L, ::std::false_type const)
+    {
+      return detail::set_result(L,
+        ::std::move(*reinterpret_cast<value_type*>(&result)));
+    }
 
-  using result_type = typename ::std::decay<C>::type;
-  result_type result;
+    args_type args;
+
+    typename ::std::aligned_storage<sizeof(value_type),
+      alignof(value_type)>::type result;
 
-  auto const end(lua_rawlen(L, I) + 1);
+    bool has_result{};
+  };
 
-  for (decltype(lua_rawlen(L, I)) i(1); i != end; ++i)
+  template <typename ...A, ::std::size_t ...I>
+  static ::std::tuple<typename ::std::decay<A>::type...>
+  copy_args(lua_State* const L, detail::indices<I...> const)
   {
-    lua_rawgeti(L, I, i);
+    using args_type = ::std::tuple<typename ::std::decay<A>::type...>;
 
-    result.emplace_back(get_arg<-1, typename result_type::value_type>(L));
+    return detail::scratch_call<A...>(L, [&]() -> args_type
+      {
+        return args_type(detail::get_arg<I + 1, A>(L)...);
+      }
+    );
   }
 
-  lua_pop(L, end - 1);
+  // the job is at the top of the stack
+  static int resume(lua_State* const L)
+  {
+    auto const w(static_cast<work*>(lua_touserdata(L, -1)));
 
-  return result;
-}
+    lua_pop(L, 1);
 
-template <int I, class C>
-inline typename ::std::enable_if<
-  is_std_vector<typename ::std::decay<C>::type>{} &&
-  !is_nc_reference<C>{},
-  typename ::std::decay<C>::type>::type
-get_arg(lua_State* const L)
-{
-  assert(lua_istable(L, I));
+    if (w->error)
+    {
+      try
+      {
+        ::std::rethrow_exception(w->error);
+      }
+      catch (::std::exception const& e)
+      {
+        lua_pushstring(L, e.what());
+      }
+      catch (...)
+      {
+        lua_pushliteral(L, "unknown exception");
+      }
 
-  using result_type = typename ::std::decay<C>::type;
-  result_type result;
+      delete w;
 
-  auto const end(lua_rawlen(L, I) + 1);
+      return lua_error(L);
+    }
+    else
+    {
+      auto const n(w->push(L));
 
-  result.reserve(end - 1);
+      delete w;
 
-  for (decltype(lua_rawlen(L, I)) i(1); i != end; ++i)
+      return n;
+    }
+  }
+
+  template <typename FP, FP fp, typename R, typename ...A>
+  static int stub(lua_State* const L)
   {
-    lua_rawgeti(L, I, i);
+    static_assert(detail::all_of<
+      !::std::is_pointer<typename ::std::decay<A>::type>{} &&
+      !detail::is_string_ref<typename ::std::decay<A>::type>{} &&
+      !detail::is_reused<typename ::std::decay<A>::type>{}...>{},
+      "arguments must be copied for the worker");
 
-    result.emplace_back(get_arg<-1, typename result_type::value_type>(L));
-  }
+    assert(sizeof...(A) == lua_gettop(L));
 
-  lua_pop(L, end - 1);
+    auto& p(get(L));
 
-  return result;
-}
+    // errors are raised before anything is registered or submitted
+    p.s_.check(L);
 
-template <int I, class C>
-inline typename ::std::enable_if<
-  is_std_map<typename ::std::decay<C>::type>{} &&
-  !is_nc_reference<C>{},
-  typename ::std::decay<C>::type>::type
-get_arg(lua_State* const L)
-{
-  assert(lua_istable(L, I));
+    work* w;
 
-  using result_type = typename ::std::decay<C>::type;
-  result_type result;
+    // the copies are destroyed before the yield
+    {
+      auto a(copy_args<A...>(L, detail::make_indices<sizeof...(A)>()));
 
-  lua_pushnil(L);
+      w = new job<FP, fp, R, A...>(::std::move(a));
+    }
 
-  while (lua_next(L, I))
-  {
-    result.emplace(get_arg<-2, typename result_type::key_type>(L),
-      get_arg<-1, typename result_type::mapped_type>(L));
+    w->co = L;
 
-    lua_pop(L, 1);
-  }
+    // the coroutine waits for its own job
+    p.s_.wait(L, L);
 
-  return result;
-}
+    lua_pushlightuserdata(L, w);
 
-template <int I, class C>
-inline typename ::std::enable_if<
-  is_std_set<typename ::std::decay<C>::type>{} &&
-  !is_nc_reference<C>{},
-  typename ::std::decay<C>::type>::type
-get_arg(lua_State* const L)
-{
-  assert(lua_istable(L, I));
+    p.submit(w);
 
-  using result_type = typename ::std::decay<C>::type;
-  result_type result;
+    return detail::yield(L, suspend<resume>{0});
+  }
 
-  auto const end(lua_rawlen(L, I) + 1);
+  template <typename FP, FP fp, typename R, typename ...A>
+  static constexpr lua_CFunction stub_of(R (* const)(A...)) noexcept
+  {
+    return &stub<FP, fp, R, A...>;
+  }
 
-  for (decltype(lua_rawlen(L, I)) i(1); i != end; ++i)
+  void submit(work* const w)
   {
-    lua_rawgeti(L, I, i);
+    w->next = {};
 
-    result.emplace(get_arg<-1, typename result_type::value_type>(L));
+    ++pending_;
+
+    {
+      ::std::lock_guard<::std::mutex> const l(m_);
+
+      (tail_ ? tail_->next : head_) = w;
+      tail_ = w;
+    }
+
+    ready_.notify_one();
   }
 
-  lua_pop(L, end - 1);
+  void work_loop()
+  {
+    for (;;)
+    {
+      work* w;
 
-  return result;
-}
+      {
+        ::std::unique_lock<::std::mutex> l(m_);
 
-template <int I, class C>
-inline typename ::std::enable_if<
-  is_std_unordered_map<typename ::std::decay<C>::type>{} &&
-  !is_nc_reference<C>{},
-  typename ::std::decay<C>::type>::type
-get_arg(lua_State* const L)
-{
-  assert(lua_istable(L, I));
+        ready_.wait(l, [this]() noexcept { return head_ || stop_; });
 
-  using result_type = typename ::std::decay<C>::type;
-  result_type result;
+        if (!head_)
+        {
+          return;
+        }
+        // else do nothing
 
-  lua_pushnil(L);
+        w = head_;
 
-  while (lua_next(L, I))
-  {
-    result.emplace(get_arg<-2, typename result_type::key_type>(L),
-      get_arg<-1, typename result_type::mapped_type>(L));
+        if (!(head_ = w->next))
+        {
+          tail_ = {};
+        }
+        // else do nothing
+      }
 
-    lua_pop(L, 1);
+      w->run();
+
+      {
+        ::std::lock_guard<::std::mutex> const l(m_);
+
+        w->next = done_;
+        done_ = w;
+      }
+
+      done_cv_.notify_one();
+    }
   }
 
-  return result;
-}
+  scheduler& s_;
 
-template <int I, class C>
-inline typename ::std::enable_if<
-  is_std_unordered_set<typename ::std::decay<C>::type>{} &&
-  !is_nc_reference<C>{},
-  typename ::std::decay<C>::type>::type
-get_arg(lua_State* const L)
-{
-  assert(lua_istable(L, I));
+  lua_State* const L_;
 
-  using result_type = typename ::std::decay<C>::type;
-  result_type result;
+  ::std::size_t pending_{};
 
-  auto const end(lua_rawlen(L, I) + 1);
+  ::std::mutex m_;
 
-  for (decltype(lua_rawlen(L, I)) i(1); i != end; ++i)
-  {
-    lua_rawgeti(L, I, i);
+  ::std::condition_variable ready_;
+  ::std::condition_variable done_cv_;
 
-    result.emplace(get_arg<-1, typename result_type::value_type>(L));
-  }
+  work* head_{};
+  work* tail_{};
+
+  work* done_{};
 
-  lua_pop(L, end - 1);
+  bool stop_{};
+
+  ::std::vector<::std::thread> threads_;
+};
 
-  return result;
+template <typename FP, FP fp>
+inline constexpr property_info static_property(char const* const name)
+  noexcept
+{
+  return {name, detail::static_stub_of<FP, fp>::get(), nullptr};
 }
 
-#endif // LUALITE_NO_STD_CONTAINERS
-
-template <class C>
-int default_finalizer(lua_State* const L)
-  noexcept(noexcept(::std::declval<C>().~C()))
+template <typename FPA, FPA fpa, typename FPB, FPB fpb>
+inline constexpr property_info static_property(char const* const name)
+  noexcept
 {
-  delete static_cast<C*>(lua_touserdata(L, lua_upvalueindex(1)));
+  return {name,
+    detail::static_stub_of<FPA, fpa>::get(),
+    detail::static_stub_of<FPB, fpb>::get()};
+}
 
-  return {};
+template <typename MP, MP mp>
+inline constexpr property_info static_readonly(char const* const name)
+  noexcept
+{
+  return {name, detail::field_stubs_of<MP, mp>::static_getter(), nullptr};
 }
 
-template <::std::size_t O, typename C, typename ...A, ::std::size_t ...I>
-inline typename ::std::enable_if<bool(!sizeof...(A)), C*>::type
-forward(lua_State* const, indices<I...> const) noexcept(noexcept(C()))
+template <typename MP, MP mp>
+inline constexpr property_info static_readwrite(char const* const name)
+  noexcept
 {
-  return new C();
+  return {name,
+    detail::field_stubs_of<MP, mp>::static_getter(),
+    detail::field_stubs_of<MP, mp>::static_setter()};
 }
 
-template <::std::size_t O, typename C, typename ...A, ::std::size_t ...I>
-inline typename ::std::enable_if<bool(sizeof...(A)), C*>::type
-forward(lua_State* const L, indices<I...> const)
-  noexcept(noexcept(C(get_arg<I + O, A>(L)...)))
+// checked by class_::properties(), names are looked up with a rawget
+template <::std::size_t N>
+inline constexpr bool unique_properties(property_info const (&p)[N])
+  noexcept
 {
-  return new C(get_arg<I + O, A>(L)...);
+  return detail::unique_properties(p, p + N);
 }
 
-template <::std::size_t O, class C, class ...A>
-int constructor_stub(lua_State* const L)
-  noexcept(noexcept(forward<O, C, A...>(L, make_indices<sizeof...(A)>())))
+#ifndef LUALITE_NO_STD_CONTAINERS
+
+// an array of records C, decoded into a vector per field, in the order of
+// fields<C>, e.g. ::std::get<0>(c)
+template <class C>
+struct columns : detail::columns_of<typename fields<C>::field_list>::type
 {
-  assert(sizeof...(A) == lua_gettop(L));
+  using record_type = C;
+};
 
-  auto const instance(forward<O, C, A...>(L, make_indices<sizeof...(A)>()));
+#endif // LUALITE_NO_STD_CONTAINERS
 
-  // table
-  lua_createtable(L, 0, default_nrec);
+// a lua_Alloc keeping free lists per size class, small blocks are carved
+// from chunks released only with the allocator, use one per state, e.g.
+// lua_newstate(pool_allocator::alloc, &pool)
+class pool_allocator
+{
+public:
+  static constexpr ::std::size_t granularity{16};
 
-  for (auto& mi: lualite::class_<C>::defs_)
-  {
-    assert(lua_istable(L, -1));
+  // blocks of up to classes * granularity bytes are pooled
+  static constexpr ::std::size_t classes{16};
 
-    lua_pushnil(L);
+  static constexpr ::std::size_t chunk_size{64 * 1024};
 
-    void* p(instance);
+  struct statistics
+  {
+    ::std::size_t live_bytes;
+    ::std::size_t peak_bytes;
 
-    for (auto const f: mi.first)
-    {
-      p = f(p);
-    }
+    // live blocks per size class, the last entry counts unpooled blocks
+    ::std::size_t blocks[classes + 1];
+  };
 
-    lua_pushlightuserdata(L, p);
-    lua_pushcclosure(L, mi.second.callback, 2);
+  pool_allocator() = default;
 
-    rawsetfield(L, -2, mi.second.name);
-  }
+  pool_allocator(pool_allocator const&) = delete;
 
-  // metatable
-  assert(lua_istable(L, -1));
-  lua_createtable(L, 0, 3);
+  pool_allocator& operator=(pool_allocator const&) = delete;
 
-  // gc
-  assert(lua_istable(L, -1));
-  lua_pushlightuserdata(L, instance);
+  // all states using the allocator must be closed by now
+  ~pool_allocator()
+  {
+    while (chunks_)
+    {
+      auto const next(*static_cast<void**>(chunks_));
 
-  lua_pushcclosure(L, default_finalizer<C>, 1);
+      ::std::free(chunks_);
 
-  rawsetfield(L, -2, "__gc");
+      chunks_ = next;
+    }
+  }
 
-  // getters
-  assert(lua_istable(L, -1));
+  lua_State* new_state() noexcept
+  {
+    return lua_newstate(alloc, this);
+  }
 
-  lua_pushnil(L);
-  lua_pushlightuserdata(L, instance);
+  statistics const& stats() const noexcept
+  {
+    return stats_;
+  }
 
-  lua_pushcclosure(L, getter<C>, 2);
+  static void* alloc(void* const ud, void* const ptr,
+    ::std::size_t const osize, ::std::size_t const nsize) noexcept
+  {
+    auto const a(static_cast<pool_allocator*>(ud));
 
-  rawsetfield(L, -2, "__index");
+    if (!nsize)
+    {
+      if (ptr)
+      {
+        a->deallocate(ptr, osize);
+      }
+      // else do nothing
 
-  // setters
-  assert(lua_istable(L, -1));
+      return nullptr;
+    }
+    else if (ptr)
+    {
+      return a->reallocate(ptr, osize, nsize);
+    }
+    else
+    {
+      // osize holds the type of the object being allocated
+      return a->allocate(nsize);
+    }
+  }
 
-  lua_pushnil(L);
-  lua_pushlightuserdata(L, instance);
+private:
+  static constexpr ::std::size_t size_class(::std::size_t const size)
+    noexcept
+  {
+    return size > classes * granularity ? classes : (size - 1) / granularity;
+  }
 
-  lua_pushcclosure(L, setter<C>, 2);
+  void account(::std::size_t const osize, ::std::size_t const nsize)
+    noexcept
+  {
+    stats_.live_bytes = stats_.live_bytes - osize + nsize;
 
-  rawsetfield(L, -2, "__newindex");
+    if (stats_.live_bytes > stats_.peak_bytes)
+    {
+      stats_.peak_bytes = stats_.live_bytes;
+    }
+    // else do nothing
+  }
 
-  lua_setmetatable(L, -2);
-  assert(lua_istable(L, -1));
+  void* carve(::std::size_t const size) noexcept
+  {
+    if (size > ::std::size_t(end_ - top_))
+    {
+      // the tail of the previous chunk is abandoned
+      auto const c(static_cast<char*>(::std::malloc(chunk_size)));
 
-  return 1;
-}
+      if (!c)
+      {
+        return nullptr;
+      }
+      // else do nothing
 
-template <::std::size_t O, typename R, typename ...A, ::std::size_t ...I>
-inline typename ::std::enable_if<bool(!sizeof...(A)), R>::type
-forward(lua_State* const, R (* const f)(A...), indices<I...> const)
-  noexcept(noexcept((*f)()))
-{
-  return (*f)();
-}
+      *reinterpret_cast<void**>(c) = chunks_;
+      chunks_ = c;
 
-template <::std::size_t O, typename R, typename ...A, ::std::size_t ...I>
-inline typename ::std::enable_if<bool(sizeof...(A)), R>::type
-forward(lua_State* const L, R (* const f)(A...), indices<I...> const)
-  noexcept(noexcept((*f)(get_arg<I + O, A>(L)...)))
-{
-  return (*f)(get_arg<I + O, A>(L)...);
-}
+      top_ = c + granularity;
+      end_ = c + chunk_size;
+    }
+    // else do nothing
 
-template <typename FP, FP fp, ::std::size_t O, class R, class ...A>
-typename ::std::enable_if<::std::is_void<R>{}, int>::type
-func_stub(lua_State* const L)
-  noexcept(noexcept(forward<O, R, A...>(L, fp, make_indices<sizeof...(A)>())))
-{
-  assert(sizeof...(A) == lua_gettop(L));
+    auto const p(top_);
 
-  forward<O, R, A...>(L, fp, make_indices<sizeof...(A)>());
+    top_ += size;
 
-  return {};
-}
+    return p;
+  }
 
-template <typename FP, FP fp, ::std::size_t O, class R, class ...A>
-typename ::std::enable_if<!::std::is_void<R>{}, int>::type
-func_stub(lua_State* const L)
-  noexcept(noexcept(set_result(L, forward<O, R, A...>(L, fp,
-    make_indices<sizeof...(A)>()))))
-{
-  return set_result(L, forward<O, R, A...>(L, fp,
-    make_indices<sizeof...(A)>()));
-}
+  void* allocate(::std::size_t const size) noexcept
+  {
+    auto const c(size_class(size));
 
-template <typename FP, FP fp, class R>
-typename ::std::enable_if<::std::is_void<R>{}, int>::type
-vararg_func_stub(lua_State* const L)
-  noexcept(noexcept(fp(L)))
-{
-  fp(L);
+    void* p;
 
-  return {};
-}
+    if (classes == c)
+    {
+      p = ::std::malloc(size);
+    }
+    else if ((p = free_[c]))
+    {
+      free_[c] = *static_cast<void**>(p);
+    }
+    else
+    {
+      p = carve((c + 1) * granularity);
+    }
 
-template <typename FP, FP fp, class R>
-typename ::std::enable_if<!::std::is_void<R>{}, int>::type
-vararg_func_stub(lua_State* const L)
-  noexcept(noexcept(set_result(fp(L))))
-{
-  return set_result(fp(L));
-}
+    if (p)
+    {
+      ++stats_.blocks[c];
 
-template <::std::size_t O, typename C, typename R, typename ...A,
-  ::std::size_t ...I>
-inline typename ::std::enable_if<bool(!sizeof...(A)), R>::type
-forward(lua_State* const, C* const c,
-  R (C::* const ptr_to_member)(A...) const, indices<I...> const)
-  noexcept(noexcept((c->*ptr_to_member)()))
-{
-  return (c->*ptr_to_member)();
-}
+      account(0, size);
+    }
+    // else do nothing
 
-template <::std::size_t O, typename C, typename R, typename ...A,
-  ::std::size_t ...I>
-inline typename ::std::enable_if<bool(sizeof...(A)), R>::type
-forward(lua_State* const L, C* const c,
-  R (C::* const ptr_to_member)(A...) const, indices<I...> const)
-  noexcept(noexcept((c->*ptr_to_member)(get_arg<I + O, A>(L)...)))
-{
-  return (c->*ptr_to_member)(get_arg<I + O, A>(L)...);
-}
+    return p;
+  }
 
-template <::std::size_t O, typename C, typename R, typename ...A,
-  ::std::size_t ...I>
-inline typename ::std::enable_if<bool(!sizeof...(A)), R>::type
-forward(lua_State* const, C* const c,
-  R (C::* const ptr_to_member)(A...), indices<I...> const)
-  noexcept(noexcept((c->*ptr_to_member)()))
-{
-  return (c->*ptr_to_member)();
-}
+  void deallocate(void* const p, ::std::size_t const size) noexcept
+  {
+    auto const c(size_class(size));
 
-template <::std::size_t O, typename C, typename R,
-  typename ...A, ::std::size_t ...I>
-inline typename ::std::enable_if<bool(sizeof...(A)), R>::type
-forward(lua_State* const L, C* const c,
-  R (C::* const ptr_to_member)(A...), indices<I...> const)
-  noexcept(noexcept((c->*ptr_to_member)(get_arg<I + O, A>(L)...)))
-{
-  return (c->*ptr_to_member)(get_arg<I + O, A>(L)...);
-}
+    if (classes == c)
+    {
+      ::std::free(p);
+    }
+    else
+    {
+      *static_cast<void**>(p) = free_[c];
+      free_[c] = p;
+    }
 
-template <typename FP, FP fp, ::std::size_t O, class C, class R, class ...A>
-typename ::std::enable_if<!::std::is_void<R>{}, int>::type
-member_stub(lua_State* const L)
-  noexcept(noexcept(set_result(L,
-    forward<O, C, R, A...>(L,
-      static_cast<C*>(lua_touserdata(L, lua_upvalueindex(2))),
-      fp,
-      make_indices<sizeof...(A)>()))))
-{
-//::std::cout << lua_gettop(L) << " " << sizeof...(A) + O - 1 << ::std::endl;
-  assert(sizeof...(A) + O - 1 == lua_gettop(L));
+    --stats_.blocks[c];
 
-  return set_result(L,
-    forward<O, C, R, A...>(L,
-      static_cast<C*>(lua_touserdata(L, lua_upvalueindex(2))),
-      fp,
-      make_indices<sizeof...(A)>()));
-}
+    account(size, 0);
+  }
 
-template <typename FP, FP fp, ::std::size_t O, class C, class R, class ...A>
-typename ::std::enable_if<::std::is_void<R>{}, int>::type
-member_stub(lua_State* const L)
-  noexcept(noexcept(forward<O, C, R, A...>(L,
-    static_cast<C*>(lua_touserdata(L, lua_upvalueindex(2))),
-    fp,
-    make_indices<sizeof...(A)>())))
-{
-  assert(sizeof...(A) + O - 1 == lua_gettop(L));
+  void* reallocate(void* ptr, ::std::size_t const osize,
+    ::std::size_t const nsize) noexcept
+  {
+    auto const c(size_class(osize));
 
-  forward<O, C, R, A...>(L,
-    static_cast<C*>(lua_touserdata(L, lua_upvalueindex(2))),
-    fp,
-    make_indices<sizeof...(A)>());
+    if (size_class(nsize) == c)
+    {
+      // pooled blocks already have room for the whole class
+      if (classes == c)
+      {
+        if (auto const p = ::std::realloc(ptr, nsize))
+        {
+          ptr = p;
+        }
+        else if (nsize > osize)
+        {
+          return nullptr;
+        }
+        // else do nothing
+      }
+      // else do nothing
 
-  return {};
-}
+      account(osize, nsize);
 
-template <typename FP, FP fp, class C, class R>
-typename ::std::enable_if<!::std::is_void<R>{}, int>::type
-vararg_member_stub(lua_State* const L)
-  noexcept(noexcept(set_result(L, (static_cast<C*>(
-    lua_touserdata(L, lua_upvalueindex(2)))->*fp)(L))))
-{
-//::std::cout << lua_gettop(L) << ::std::endl;
-  return set_result(L, (static_cast<C*>(
-    lua_touserdata(L, lua_upvalueindex(2)))->*fp)(L));
-}
+      return ptr;
+    }
+    else if (auto const p = allocate(nsize))
+    {
+      ::std::memcpy(p, ptr, osize < nsize ? osize : nsize);
 
-template <typename FP, FP fp, class C, class R>
-typename ::std::enable_if<::std::is_void<R>{}, int>::type
-vararg_member_stub(lua_State* const L)
-  noexcept(noexcept(
-    (static_cast<C*>(lua_touserdata(L, lua_upvalueindex(2)))->*fp)(L)))
-{
-//::std::cout << lua_gettop(L) << ::std::endl;
-  (static_cast<C*>(lua_touserdata(L, lua_upvalueindex(2)))->*fp)(L);
+      deallocate(ptr, osize);
 
-  return {};
-}
+      return p;
+    }
+    else if (nsize <= osize)
+    {
+      // Lua assumes shrinking never fails, the block joins the smaller
+      // class, a large block is then not freed with the allocator
+      --stats_.blocks[c];
+      ++stats_.blocks[size_class(nsize)];
 
-template <typename ...A>
-inline void call(lua_State* const L, int const nresults, A&& ...args)
-  noexcept(noexcept(swallow{(set_result(L, ::std::forward<A>(args)))...}))
-{
-  int ac{};
+      account(osize, nsize);
 
-  swallow{
-    (ac += set_result(L, ::std::forward<A>(args)))...
-  };
-  assert(decltype(sizeof...(A))(ac) <= sizeof...(A));
+      return ptr;
+    }
+    else
+    {
+      return nullptr;
+    }
+  }
 
-  lua_call(L, ac, nresults);
-}
+  void* free_[classes]{};
 
-} // detail
+  void* chunks_{};
 
-template <typename ...A>
-inline void call(lua_State* const L, int const nresults, A&& ...args)
-  noexcept(noexcept(detail::call(L, nresults, ::std::forward<A>(args)...)))
-{
-  detail::call(L, nresults, ::std::forward<A>(args)...);
-}
+  char* top_{};
+  char* end_{};
+
+  statistics stats_{};
+};
 
 class scope
 {
@@ -1505,7 +5271,7 @@ public:
   scope(char const* const name, A&&... args) :
     name_(name)
   {
-    detail::swallow((args.set_parent_scope(this), 0)...);
+    detail::swallow{(args.set_parent_scope(this), 0)...};
   }
 
   scope(scope const&) = delete;
@@ -1573,10 +5339,19 @@ public:
     return *this;
   }
 
-  template <typename FP, FP fp>
+  template <typename FP, FP fp>
+  scope& def(char const* const name)
+  {
+    push_function<FP, fp>(name, fp);
+
+    return *this;
+  }
+
+  template <class ...O>
   scope& def(char const* const name)
   {
-    push_function<FP, fp>(name, fp);
+    functions_.push_back({name,
+      detail::overload_stub<1, detail::overload_candidate<1, O>...>});
 
     return *this;
   }
@@ -1596,6 +5371,15 @@ public:
     return *this;
   }
 
+  // the body runs on the worker_pool of the state
+  template <typename FP, FP fp>
+  scope& async_def(char const* const name)
+  {
+    functions_.push_back({name, worker_pool::stub_of<FP, fp>(fp)});
+
+    return *this;
+  }
+
 protected:
   virtual void apply(lua_State* const L)
   {
@@ -1647,9 +5431,7 @@ protected:
       {
         assert(lua_istable(L, -1));
 
-        lua_pushnil(L);
-
-        lua_pushcclosure(L, i.callback, 1);
+        lua_pushcfunction(L, i.callback);
 
         detail::rawsetfield(L, -2, i.name);
       }
@@ -1668,9 +5450,7 @@ protected:
 
       for (auto& i: detail::as_const(functions_))
       {
-        lua_pushnil(L);
-
-        lua_pushcclosure(L, i.callback, 1);
+        lua_pushcfunction(L, i.callback);
 
         lua_setglobal(L, i.name);
       }
@@ -1807,7 +5587,7 @@ public:
     scope(nullptr),
     L_(L)
   {
-    detail::swallow((args.set_parent_scope(this), 0)...);
+    detail::swallow{(args.set_parent_scope(this), 0)...};
 
     scope::apply(L);
   }
@@ -1817,7 +5597,7 @@ public:
     scope(name),
     L_(L)
   {
-    [](...){}((args.set_parent_scope(this), 0)...);
+    detail::swallow{(args.set_parent_scope(this), 0)...};
 
     scope::apply(L);
   }
@@ -1950,6 +5730,32 @@ public:
     return *this;
   }
 
+  template <class ...O>
+  module& def(char const* const name)
+  {
+    if (name_)
+    {
+      scope::get_scope(L_);
+      assert(lua_istable(L_, -1));
+
+      lua_pushcfunction(L_,
+        (detail::overload_stub<1, detail::overload_candidate<1, O>...>));
+
+      detail::rawsetfield(L_, -2, name);
+
+      lua_pop(L_, 1);
+    }
+    else
+    {
+      lua_pushcfunction(L_,
+        (detail::overload_stub<1, detail::overload_candidate<1, O>...>));
+
+      lua_setglobal(L_, name);
+    }
+
+    return *this;
+  }
+
   module& enum_(char const* const name, int const value)
   {
     return constant(name, lua_Number(value));
@@ -1979,39 +5785,62 @@ public:
     return *this;
   }
 
+  template <typename FP, FP fp>
+  module& async_def(char const* const name)
+  {
+    if (name_)
+    {
+      scope::get_scope(L_);
+      assert(lua_istable(L_, -1));
+
+      lua_pushcfunction(L_, (worker_pool::stub_of<FP, fp>(fp)));
+
+      detail::rawsetfield(L_, -2, name);
+
+      lua_pop(L_, 1);
+    }
+    else
+    {
+      lua_pushcfunction(L_, (worker_pool::stub_of<FP, fp>(fp)));
+
+      lua_setglobal(L_, name);
+    }
+
+    return *this;
+  }
+
 private:
   template <typename FP, FP fp, typename R, typename ...A>
   void push_function(R (* const)(A...))
   {
-    lua_pushnil(L_);
-    lua_pushcclosure(L_, detail::func_stub<FP, fp, 1, R, A...>, 1);
+    lua_pushcfunction(L_, (detail::func_stub<FP, fp, 1, R, A...>));
   }
 
   template <typename FP, FP fp, typename R>
   void push_vararg_function(R (* const)(lua_State*))
   {
-    lua_pushnil(L_);
-    lua_pushcclosure(L_, detail::vararg_func_stub<FP, fp, R>, 1);
+    lua_pushcfunction(L_, (detail::vararg_func_stub<FP, fp, R>));
   }
 
 private:
   lua_State* const L_;
 };
 
-using accessors_type = ::std::unordered_map<char const*,
-  ::std::pair<::std::vector<void* (*)(void*)>, detail::map_member_info_type>,
-  detail::str_hash, detail::str_eq>;
+using accessors_type = ::std::vector<detail::func_info_type>;
+
+using defs_type = ::std::vector<detail::member_info_type>;
 
-using defs_type = ::std::vector<::std::pair<::std::vector<void* (*)(void*)>,
-  detail::member_info_type> >;
+using properties_type = ::std::vector<::std::pair<property_info const*,
+  ::std::size_t> >;
 
+// registrations are kept in the class_ object and applied to the tables of
+// a single lua_State, registering C again extends them
 template <class C>
 class class_ : public scope
 {
 public:
   class_(char const* const name) : scope(name)
   {
-    class_name_ = name;
   }
 
   template <typename T>
@@ -2035,51 +5864,40 @@ public:
     return *this;
   }
 
-  template <class ...A>
-  class_& inherits()
+  // signatures, e.g. constructors<void(), void(int)>()
+  template <class ...S>
+  class_& constructors(char const* const name = "new")
   {
-    detail::swallow{
-      (S<A>::copy_accessors(class_<A>::getters_, getters_), 0)...
-    };
+    constructors_.push_back({name,
+      detail::overload_stub<1, detail::overload_candidate<1, S, C>...>});
 
-    detail::swallow{
-      (S<A>::copy_accessors(class_<A>::setters_, setters_), 0)...
-    };
-
-    detail::swallow{
-      (S<A>::copy_defs(class_<A>::defs_, defs_), 0)...
-    };
+    return *this;
+  }
 
-    assert(inherits_.empty());
-    inherits_.reserve(sizeof...(A));
+  // bases must be registered with the same lua_State first, e.g. earlier
+  // in the same module, registering C raises an error otherwise
+  template <class ...A>
+  class_& inherits()
+  {
     detail::swallow{
-      (inherits_.push_back(class_<A>::inherits), 0)...
+      (bases_.push_back({&detail::class_tag<A>::key,
+        S<A>::step(detail::is_virtual_base_of<A, C>())}), 0)...
     };
 
     return *this;
   }
 
-  static bool inherits(char const* const name) noexcept
+  static bool inherits(lua_State* const L, char const* const name)
   {
-    assert(class_name_ && name);
+    assert(name);
 
-    if (::std::strcmp(name, class_name_))
-    {
-      for (auto const f: inherits_)
-      {
-        if (f(name))
-        {
-          return true;
-        }
-        // else do nothing
-      }
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &detail::class_tag<C>::key);
 
-      return false;
-    }
-    else
-    {
-      return true;
-    }
+    auto const r(lua_istable(L, -1) && detail::inherits(L, name));
+
+    lua_pop(L, 1);
+
+    return r;
   }
 
   template <typename FP, FP fp>
@@ -2101,8 +5919,16 @@ public:
   >::type
   def(char const* const name)
   {
-    defs_.push_back({{},
-      detail::member_info_type{name, member_stub<FP, fp, 2>(fp)}});
+    defs_.push_back({name, member_stub<FP, fp, 2>(fp), false});
+
+    return *this;
+  }
+
+  template <class ...O>
+  class_& def(char const* const name)
+  {
+    defs_.push_back({name,
+      detail::overload_stub<2, detail::overload_candidate<2, O>...>, false});
 
     return *this;
   }
@@ -2114,8 +5940,7 @@ public:
   >::type
   def_func(char const* const name)
   {
-    defs_.push_back({{},
-      detail::member_info_type{name, member_stub<FP, fp, 1>(fp)}});
+    defs_.push_back({name, member_stub<FP, fp, 1>(fp), true});
 
     return *this;
   }
@@ -2127,8 +5952,7 @@ public:
   >::type
   def_func(char const* const name)
   {
-    defs_.push_back({{},
-      detail::member_info_type{name, func_stub<FP, fp, 1>(fp)}});
+    defs_.push_back({name, func_stub<FP, fp, 1>(fp), false});
 
     return *this;
   }
@@ -2143,8 +5967,44 @@ public:
   template <class FP, FP fp>
   class_& property(char const* const name)
   {
-    getters_.emplace(name, accessors_type::mapped_type{
-      {}, member_stub<FP, fp, 3>(fp)});
+    getters_.push_back({name, member_stub<FP, fp, 3>(fp)});
+
+    return *this;
+  }
+
+  template <typename MP, MP mp>
+  class_& def_readonly(char const* const name)
+  {
+    static_assert(::std::is_member_object_pointer<MP>{},
+      "MP must be a pointer to data member");
+
+    getters_.push_back({name, detail::field_stubs_of<MP, mp>::getter()});
+
+    return *this;
+  }
+
+  template <typename MP, MP mp>
+  class_& def_readwrite(char const* const name)
+  {
+    static_assert(::std::is_member_object_pointer<MP>{},
+      "MP must be a pointer to data member");
+
+    getters_.push_back({name, detail::field_stubs_of<MP, mp>::getter()});
+    setters_.push_back({name, detail::field_stubs_of<MP, mp>::setter()});
+
+    return *this;
+  }
+
+  // the table must be constexpr, e.g. properties<LLFUNC(table)>()
+  template <typename P, P p>
+  class_& properties()
+  {
+    static_assert(::std::is_array<typename ::std::remove_pointer<P>::type>{},
+      "P must be a pointer to an array of property_info");
+    static_assert(unique_properties(*p), "property names must be unique");
+
+    properties_.emplace_back(*p,
+      ::std::extent<typename ::std::remove_pointer<P>::type>{});
 
     return *this;
   }
@@ -2152,10 +6012,20 @@ public:
   template <typename FPA, FPA fpa, typename FPB, FPB fpb>
   class_& property(char const* const name)
   {
-    getters_.emplace(name, accessors_type::mapped_type{
-      {}, member_stub<FPA, fpa, 3>(fpa)});
-    setters_.emplace(name, accessors_type::mapped_type{
-      {}, member_stub<FPB, fpb, 3>(fpb)});
+    getters_.push_back({name, member_stub<FPA, fpa, 3>(fpa)});
+    setters_.push_back({name, member_stub<FPB, fpb, 3>(fpb)});
+
+    return *this;
+  }
+
+  template <typename FP, FP fp>
+  typename ::std::enable_if<
+    detail::is_function_pointer<FP>{},
+    class_&
+  >::type
+  async_def(char const* const name)
+  {
+    scope::async_def<FP, fp>(name);
 
     return *this;
   }
@@ -2167,8 +6037,7 @@ public:
   >::type
   vararg_def(char const* const name)
   {
-    defs_.push_back({{},
-      detail::member_info_type{name, vararg_member_stub<FP, fp>(fp)}});
+    defs_.push_back({name, vararg_member_stub<FP, fp>(fp), false});
 
     return *this;
   }
@@ -2177,58 +6046,267 @@ private:
   template <class A>
   struct S
   {
-    static void copy_defs(defs_type const& src, defs_type& dst)
+    static detail::cast_step step(::std::true_type const) noexcept
     {
-      for (auto& a: src)
-      {
-        dst.push_back(a);
-
-        dst.back().first.emplace_back(convert<A>);
-        dst.back().first.shrink_to_fit();
-      }
+      return {convert<A>, {}};
     }
 
-    static void copy_accessors(accessors_type const& src,
-      accessors_type& dst)
+    static detail::cast_step step(::std::false_type const) noexcept
     {
-      for (auto& a: src)
-      {
-        auto& n(dst[a.first] = {a.second.first, a.second.second});
+      typename ::std::aligned_storage<sizeof(C), alignof(C)>::type s;
 
-        n.first.emplace_back(convert<A>);
-        n.first.shrink_to_fit();
-      }
+      auto const c(reinterpret_cast<C*>(&s));
+
+      return {nullptr, reinterpret_cast<char*>(static_cast<A*>(c)) -
+        reinterpret_cast<char*>(c)};
     }
   };
 
   void apply(lua_State* const L)
   {
     assert(parent_scope_);
+
+    // see inherits()
+    for (auto& a: detail::as_const(bases_))
+    {
+      lua_rawgetp(L, LUA_REGISTRYINDEX, a.key);
+
+      if (!lua_istable(L, -1))
+      {
+        luaL_error(L, "base class %d of %s not registered",
+          int(&a - bases_.data() + 1), name_);
+      }
+      // else do nothing
+
+      lua_pop(L, 1);
+    }
+
     scope::apply(L);
 
     scope::get_scope(L);
     assert(lua_istable(L, -1));
 
-    for (auto& i: detail::as_const(constructors_))
+    push_metatable(L);
+    assert(lua_istable(L, -1));
+
+    auto const mt(lua_gettop(L));
+
+    // getters, methods, bound methods and setters
+    detail::push_accessors(L);
+
+    auto const g(mt + 1), m(mt + 2), b(mt + 3), s(mt + 4);
+
+    for (auto& mi: detail::as_const(defs_))
+    {
+      // methods take precedence over properties of the same name
+      lua_pushnil(L);
+      detail::rawsetfield(L, g, mi.name);
+
+      if (mi.bound)
+      {
+        push_member(L, mi.callback);
+
+        detail::rawsetfield(L, b, mi.name);
+      }
+      else
+      {
+        push_method(L, mi.callback, mt);
+
+        detail::rawsetfield(L, m, mi.name);
+      }
+    }
+
+    for (auto& a: detail::as_const(getters_))
+    {
+      if (!is_method(L, m, a.name))
+      {
+        push_member(L, a.callback);
+
+        detail::rawsetfield(L, g, a.name);
+      }
+      // else do nothing
+    }
+
+    // static properties override dynamic ones
+    for (auto& a: detail::as_const(properties_))
+    {
+      for (auto i(a.first), end(a.first + a.second); i != end; ++i)
+      {
+        if (!is_method(L, m, i->name))
+        {
+          lua_pushlightuserdata(L, const_cast<property_info*>(i));
+
+          detail::rawsetfield(L, g, i->name);
+        }
+        // else do nothing
+      }
+    }
+
+    for (auto& a: detail::as_const(setters_))
+    {
+      push_member(L, a.callback);
+
+      detail::rawsetfield(L, s, a.name);
+    }
+
+    for (auto& a: detail::as_const(properties_))
+    {
+      for (auto i(a.first), end(a.first + a.second); i != end; ++i)
+      {
+        if (i->setter)
+        {
+          lua_pushlightuserdata(L, const_cast<property_info*>(i));
+
+          detail::rawsetfield(L, s, i->name);
+        }
+        // else do nothing
+      }
+    }
+
+    // members of C hide the members of its bases
+    for (auto& a: detail::as_const(bases_))
     {
+      lua_rawgetp(L, LUA_REGISTRYINDEX, a.key);
       assert(lua_istable(L, -1));
-      lua_pushcfunction(L, i.callback);
 
-      detail::rawsetfield(L, -2, i.name);
+      // see detail::inherits()
+      lua_pushvalue(L, -1);
+      lua_rawseti(L, mt, lua_rawlen(L, mt) + 1);
+
+      detail::push_accessors(L);
+
+      auto const bmt(lua_gettop(L) - 4);
+
+      detail::inherit(L, bmt + 2, m, g, b, a.step, {},
+        detail::checked ? mt : 0);
+      detail::inherit(L, bmt + 3, b, g, b, a.step, {});
+      detail::inherit(L, bmt + 1, g, g, b, a.step, &property_info::getter);
+      detail::inherit(L, bmt + 4, s, s, s, a.step, &property_info::setter);
+
+      lua_pop(L, 5);
     }
 
-    // lua_pushstring(L, name_);
-    // detail::rawsetfield(L, -2, "__classname");
+    lua_pop(L, 4);
+
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &detail::class_tag<C>::cache);
+    assert(lua_istable(L, -1));
 
-    assert(inherits_.capacity() == inherits_.size());
-    constructors_.shrink_to_fit();
-    defs_.shrink_to_fit();
+    for (auto& i: detail::as_const(constructors_))
+    {
+      assert(lua_istable(L, -3));
+      lua_pushvalue(L, -2);
+      lua_pushvalue(L, -2);
+      lua_pushcclosure(L, i.callback, 2);
 
-    lua_pop(L, 1);
+      detail::rawsetfield(L, -4, i.name);
+    }
+
+    lua_pop(L, 3);
 
     assert(!lua_gettop(L));
   }
 
+  // all instances of C in a lua_State share a single metatable
+  void push_metatable(lua_State* const L) const
+  {
+    auto const key(&detail::class_tag<C>::key);
+
+    lua_rawgetp(L, LUA_REGISTRYINDEX, key);
+
+    if (lua_isnil(L, -1))
+    {
+      lua_pop(L, 1);
+
+      lua_createtable(L, bases_.size(), 4);
+
+      // gc
+      lua_pushcfunction(L, detail::default_finalizer<C>);
+
+      detail::rawsetfield(L, -2, "__gc");
+
+      lua_pushstring(L, name_);
+
+      detail::rawsetfield(L, -2, "__name");
+
+      detail::protect_metatable(L);
+
+      ::std::size_t nprops{};
+
+      for (auto& a: properties_)
+      {
+        nprops += a.second;
+      }
+
+      // getters, methods and bound methods
+      lua_createtable(L, 0, getters_.size() + nprops);
+      lua_createtable(L, 0, defs_.size());
+      lua_newtable(L);
+
+      lua_pushcclosure(L, detail::getter, 3);
+
+      detail::rawsetfield(L, -2, "__index");
+
+      // setters
+      lua_createtable(L, 0, setters_.size());
+
+      lua_pushcclosure(L, detail::setter, 1);
+
+      detail::rawsetfield(L, -2, "__newindex");
+
+      lua_pushvalue(L, -1);
+      lua_rawsetp(L, LUA_REGISTRYINDEX, key);
+
+      // instance cache
+      lua_newtable(L);
+      lua_createtable(L, 0, 1);
+
+      lua_pushliteral(L, "v");
+      detail::rawsetfield(L, -2, "__mode");
+
+      lua_setmetatable(L, -2);
+
+      lua_rawsetp(L, LUA_REGISTRYINDEX, &detail::class_tag<C>::cache);
+    }
+    // else do nothing
+  }
+
+  // table m is followed by the bound method table
+  static bool is_method(lua_State* const L, int const m,
+    char const* const name)
+  {
+    detail::rawgetfield(L, m, name);
+    detail::rawgetfield(L, m + 1, name);
+
+    auto const r(!lua_isnil(L, -2) || !lua_isnil(L, -1));
+
+    lua_pop(L, 2);
+
+    return r;
+  }
+
+  // direct members need no cast, see detail::convert()
+  static void push_member(lua_State* const L, lua_CFunction const f)
+  {
+    lua_pushnil(L);
+    lua_pushcclosure(L, f, 1);
+  }
+
+  // see detail::check_self()
+  static void push_method(lua_State* const L, lua_CFunction const f,
+    int const mt)
+  {
+    if (detail::checked)
+    {
+      lua_pushnil(L);
+      lua_pushvalue(L, mt);
+      lua_pushcclosure(L, f, 2);
+    }
+    else
+    {
+      push_member(L, f);
+    }
+  }
+
   template <class A>
   static void* convert(void* const a)
   {
@@ -2265,37 +6343,19 @@ private:
     return &detail::vararg_member_stub<FP, fp, C, R>;
   }
 
-public:
-  static char const* class_name_;
+private:
+  ::std::vector<detail::base_info_type> bases_;
 
-  static ::std::vector<bool(*)(char const*)> inherits_;
+  ::std::vector<detail::func_info_type> constructors_;
 
-  static ::std::vector<detail::func_info_type> constructors_;
+  defs_type defs_;
 
-  static defs_type defs_;
+  accessors_type getters_;
+  accessors_type setters_;
 
-  static accessors_type getters_;
-  static accessors_type setters_;
+  properties_type properties_;
 };
 
-template <class C>
-char const* class_<C>::class_name_;
-
-template <class C>
-::std::vector<bool(*)(char const*)> class_<C>::inherits_;
-
-template <class C>
-::std::vector<detail::func_info_type> class_<C>::constructors_;
-
-template <class C>
-defs_type class_<C>::defs_;
-
-template <class C>
-accessors_type class_<C>::getters_;
-
-template <class C>
-accessors_type class_<C>::setters_;
-
 } // lualite
 
 #endif // LUALITE_HPP
@@ -16,45 +16,21 @@ struct point
   int y;
 };
 
-inline int set_result(lua_State* const L, point p)
+namespace lualite
 {
-  using namespace ::lualite::detail;
 
-  lua_createtable(L, 2, 0);
-
-  lua_pushliteral(L, "x");
-  set_result(L, const_cast<decltype(p.x) const&>(p.x));
-  assert(lua_istable(L, -3));
-  lua_rawset(L, -3);
-
-  lua_pushliteral(L, "y");
-  set_result(L, const_cast<decltype(p.y) const&>(p.y));
-  assert(lua_istable(L, -3));
-  lua_rawset(L, -3);
-
-  return 1;
-}
-
-template <std::size_t I, typename T>
-inline typename std::enable_if<
-  std::is_same<T, point>::value, point>::type
-get_arg(lua_State* const L)
+template <>
+struct fields<point> :
+  field_list<field<LLFUNC(point::x)>, field<LLFUNC(point::y)> >
 {
-  using namespace ::lualite::detail;
-
-  assert(lua_istable(L, I));
-
-  struct point p;
-
-  lua_pushliteral(L, "x");
-  lua_rawget(L, -2);
-  p.x = lua_tointeger(L, -1);
+  static char const* const* names() noexcept
+  {
+    static char const* const n[]{"x", "y"};
 
-  lua_pushliteral(L, "y");
-  lua_rawget(L, -2);
-  p.y = lua_tointeger(L, -1);
+    return n;
+  }
+};
 
-  return p;
 }
 
 point testfunc(int i, int j, int k)
@@ -151,6 +127,844 @@ private:
   std::string s_;
 };
 
+struct counted
+{
+  static int live;
+
+  counted() { ++live; }
+
+  counted(counted const&) { ++live; }
+
+  ~counted() { --live; }
+
+  counted copy() const { return *this; }
+};
+
+int counted::live;
+
+void register_counted(lua_State* const L)
+{
+  luaL_openlibs(L);
+
+  lualite::module(L,
+    lualite::class_<counted>("counted")
+      .constructor("new")
+      .def<LLFUNC(counted::copy)>("copy")
+  );
+
+  luaL_dostring(
+    L,
+    "t = {}\n"
+    "for i = 1, 1000 do\n"
+    "  t[i] = counted.new():copy()\n"
+    "end\n"
+    "collectgarbage()\n"
+    "s = string.rep(\"x\", 100000)\n"
+  );
+}
+
+void test_allocators()
+{
+  {
+    lualite::pool_allocator a;
+
+    auto const L(a.new_state());
+
+    register_counted(L);
+
+    auto const& s(a.stats());
+
+    std::cout << "pool: " << counted::live << " live objects, " <<
+      (s.live_bytes <= s.peak_bytes) << " " << (s.blocks[0] > 0) << " " <<
+      (s.blocks[lualite::pool_allocator::classes] > 0) << std::endl;
+
+    lua_close(L);
+
+    std::size_t blocks{};
+
+    for (auto const b: s.blocks)
+    {
+      blocks += b;
+    }
+
+    std::cout << "pool closed: " << counted::live << " " << s.live_bytes <<
+      " " << blocks << std::endl;
+  }
+
+  lualite::region_allocator r;
+
+  for (auto i(0); i != 2; ++i)
+  {
+    auto const L(r.new_state());
+
+    register_counted(L);
+
+    std::cout << "region: " << counted::live << " live objects" << std::endl;
+
+    r.close(L);
+
+    std::cout << "region closed: " << counted::live << std::endl;
+  }
+}
+
+int event;
+
+lualite::suspend<> wait_event(lua_State* const L)
+{
+  return lualite::scheduler::get(L).wait(L, &event);
+}
+
+void print_error(lua_State* const co, int)
+{
+  std::cout << "task failed: " << lua_tostring(co, -1) << std::endl;
+}
+
+void test_scheduler()
+{
+  auto const L(luaL_newstate());
+
+  luaL_openlibs(L);
+
+  {
+    lualite::scheduler s(L, print_error);
+
+    lualite::module(L,
+      lualite::scope("sched")
+        .vararg_def<LLFUNC(lualite::scheduler::sleep)>("sleep")
+        .vararg_def<LLFUNC(wait_event)>("wait")
+    );
+
+    luaL_dostring(
+      L,
+      "order = {}\n"
+      "function sleeper(i)\n"
+      "  sched.sleep(0.001 * i)\n"
+      "  order[#order + 1] = i\n"
+      "end\n"
+      "function waiter()\n"
+      "  sched.wait()\n"
+      "  order[#order + 1] = \"woken\"\n"
+      "end\n"
+      "function sorter()\n"
+      "  local t = { 3, 1, 2 }\n"
+      "  print(pcall(table.sort, t, function(a, b)\n"
+      "    sched.sleep(0.001)\n"
+      "    return a < b\n"
+      "  end))\n"
+      "end\n"
+    );
+
+    for (auto const i: {3, 1, 2})
+    {
+      lua_getglobal(L, "sleeper");
+      lua_pushinteger(L, i);
+      s.spawn(L, 1);
+    }
+
+    lua_getglobal(L, "waiter");
+    s.spawn(L, 0);
+
+    lua_getglobal(L, "sorter");
+    s.spawn(L, 0);
+
+    s.run();
+
+    std::cout << "scheduler: " << s.size() << " waiting" << std::endl;
+
+    s.notify(&event);
+
+    s.run();
+
+    std::cout << "scheduler: " << s.size() << " waiting" << std::endl;
+
+    luaL_dostring(L, "print(table.concat(order, \" \"))");
+  }
+
+  lua_close(L);
+}
+
+std::string repeat(std::string const& s, int const n)
+{
+  std::string r;
+
+  for (auto i(0); i != n; ++i)
+  {
+    r += s;
+  }
+
+  return r;
+}
+
+void test_worker_pool()
+{
+  auto const L(luaL_newstate());
+
+  luaL_openlibs(L);
+
+  {
+    lualite::scheduler s(L, print_error);
+
+    lualite::module(L).async_def<LLFUNC(repeat)>("repeat_");
+
+    luaL_dostring(L, "print(pcall(repeat_, \"ab\", 2))");
+
+    lualite::worker_pool p(s, 2);
+
+    luaL_dostring(
+      L,
+      "print(pcall(repeat_, \"ab\", 2))\n"
+      "results = {}\n"
+      "function worker(i)\n"
+      "  results[i] = #repeat_(\"ab\", i)\n"
+      "end\n"
+      "function sorter()\n"
+      "  local t = { 3, 1, 2 }\n"
+      "  print(pcall(table.sort, t, function(a, b)\n"
+      "    return #repeat_(\"x\", a) < #repeat_(\"x\", b)\n"
+      "  end))\n"
+      "end\n"
+    );
+
+    for (auto i(1); i != 5; ++i)
+    {
+      lua_getglobal(L, "worker");
+      lua_pushinteger(L, i);
+      s.spawn(L, 1);
+    }
+
+    lua_getglobal(L, "sorter");
+    s.spawn(L, 0);
+
+    p.run();
+
+    std::cout << "worker_pool: " << s.size() << " waiting, " << p.pending() <<
+      " pending" << std::endl;
+
+    luaL_dostring(L, "print(table.concat(results, \" \"))");
+  }
+
+  lua_close(L);
+}
+
+struct tagged
+{
+  int tag{1};
+
+  int get_tag() const { return tag; }
+
+  void set_tag(int const t) { tag = t; }
+};
+
+constexpr lualite::property_info tagged_properties[]{
+  lualite::static_property<LLFUNC(tagged::get_tag),
+    LLFUNC(tagged::set_tag)>("tag"),
+  lualite::static_readonly<LLFUNC(tagged::tag)>("raw_tag")
+};
+
+struct padding
+{
+  double pad[4];
+};
+
+// tagged is not at the start of tagged_item, its properties need a cast
+struct tagged_item : padding, tagged
+{
+};
+
+struct special_item : tagged_item
+{
+};
+
+void test_static_properties()
+{
+  auto const L(luaL_newstate());
+
+  luaL_openlibs(L);
+
+  lualite::module(L,
+    lualite::class_<tagged>("tagged")
+      .constructor("new")
+      .properties<LLFUNC(tagged_properties)>(),
+    lualite::class_<tagged_item>("tagged_item")
+      .constructor("new")
+      .inherits<tagged>(),
+    lualite::class_<special_item>("special_item")
+      .constructor("new")
+      .inherits<tagged_item>()
+  );
+
+  luaL_dostring(
+    L,
+    "local a, b, c = tagged.new(), tagged_item.new(), special_item.new()\n"
+    "a.tag = 2\n"
+    "b.tag = 3\n"
+    "c.tag = 4\n"
+    "print(a.tag, a.raw_tag, b.tag, b.raw_tag, c.tag, c.raw_tag)\n"
+    "c.raw_tag = 5\n"
+    "print(c.raw_tag)\n"
+  );
+
+  lua_close(L);
+}
+
+struct sample
+{
+  int count{1};
+
+  double mean{2.5};
+
+  std::string label{"sample"};
+};
+
+struct weighted_sample : padding, sample
+{
+  double weight{.5};
+};
+
+void test_data_members()
+{
+  auto const L(luaL_newstate());
+
+  luaL_openlibs(L);
+
+  lualite::module(L,
+    lualite::class_<sample>("sample")
+      .constructor("new")
+      .def_readwrite<LLFUNC(sample::count)>("count")
+      .def_readwrite<LLFUNC(sample::mean)>("mean")
+      .def_readonly<LLFUNC(sample::label)>("label"),
+    lualite::class_<weighted_sample>("weighted_sample")
+      .constructor("new")
+      .inherits<sample>()
+      .def_readwrite<LLFUNC(weighted_sample::weight)>("weight")
+  );
+
+  luaL_dostring(
+    L,
+    "local s, w = sample.new(), weighted_sample.new()\n"
+    "s.count = 10\n"
+    "s.mean = .25\n"
+    "s.label = \"ignored\"\n"
+    "w.count = 20\n"
+    "w.weight = 2\n"
+    "print(s.count, s.mean, s.label, w.count, w.mean, w.label, w.weight)\n"
+  );
+
+  lua_close(L);
+}
+
+#ifdef LUALITE_CHECKED
+
+std::vector<int> const primes{2, 3, 5, 7};
+
+lualite::view<std::vector<int> > prime_view()
+{
+  return lualite::view<std::vector<int> >(primes);
+}
+
+#endif // LUALITE_CHECKED
+
+lualite::array<double> halves(int const n)
+{
+  return lualite::array<double>(n, .5);
+}
+
+// receivers from scripts are only checked with LUALITE_CHECKED
+void test_checked()
+{
+#ifdef LUALITE_CHECKED
+  auto const L(luaL_newstate());
+
+  luaL_openlibs(L);
+
+  lualite::module(L,
+    lualite::class_<sample>("sample")
+      .constructor("new")
+      .def_readwrite<LLFUNC(sample::count)>("count"),
+    lualite::class_<counted>("counted")
+      .constructor("new")
+      .def<LLFUNC(counted::copy)>("copy")
+  )
+  .def<LLFUNC(prime_view)>("prime_view")
+  .def<LLFUNC(halves)>("halves");
+
+  luaL_dostring(
+    L,
+    "local s, c = sample.new(), counted.new()\n"
+    "print(getmetatable(s), getmetatable(prime_view()), "
+      "getmetatable(halves(1)))\n"
+    "print(pcall(c.copy, s))\n"
+    "print(pcall(c.copy, io.stdout))\n"
+    "local a = halves(2)\n"
+    "print(pcall(a.totable, io.stdout))\n"
+    "local f = pairs(prime_view())\n"
+    "print(pcall(f, io.stdout, 0))\n"
+    "print(f(prime_view(), 0))\n"
+  );
+
+  lua_close(L);
+#endif // LUALITE_CHECKED
+}
+
+lualite::string_ref first_word(lualite::string_ref const s)
+{
+  std::size_t n{};
+
+  while ((n != s.size()) && (' ' != s.data()[n]))
+  {
+    ++n;
+  }
+
+  return {s.data(), n};
+}
+
+std::size_t width(lualite::string_ref const s)
+{
+  return s.size();
+}
+
+std::size_t width(int n)
+{
+  std::size_t w(n <= 0);
+
+  for (; n; n /= 10)
+  {
+    ++w;
+  }
+
+  return w;
+}
+
+void test_string_ref()
+{
+  auto const L(luaL_newstate());
+
+  luaL_openlibs(L);
+
+  lualite::module(L)
+    .def<LLFUNC(first_word)>("first_word")
+    .def<lualite::overload<std::size_t (*)(lualite::string_ref), &width>,
+      lualite::overload<std::size_t (*)(int), &width> >("width");
+
+  luaL_dostring(
+    L,
+    "print(first_word(\"borrowed strings\"), first_word(\"\"))\n"
+    "print(width(\"a\\0b\"), width(-120), width(\"\"))\n"
+    "print(pcall(width, {}))\n"
+  );
+
+  lua_close(L);
+}
+
+struct inventory
+{
+  std::vector<std::string> items{"apple", "pear"};
+
+  std::map<int, std::string> slots{{1, "apple"}, {3, "pear"}};
+
+  lualite::view<std::vector<std::string> > item_view() const
+  {
+    return lualite::view<std::vector<std::string> >(items);
+  }
+
+  lualite::view<std::map<int, std::string> > slot_view() const
+  {
+    return lualite::view<std::map<int, std::string> >(slots);
+  }
+};
+
+void test_views()
+{
+  auto const L(luaL_newstate());
+
+  luaL_openlibs(L);
+
+  lualite::module(L,
+    lualite::class_<inventory>("inventory")
+      .constructor("new")
+      .def<LLFUNC(inventory::item_view)>("items")
+      .def<LLFUNC(inventory::slot_view)>("slots")
+  );
+
+  luaL_dostring(
+    L,
+    "local o = inventory.new()\n"
+    "local items, slots = o:items(), o:slots()\n"
+    "o = nil\n"
+    "collectgarbage()\n"
+    "print(#items, items[1], items[2], items[3], items[1.5])\n"
+    "for k, v in pairs(slots) do\n"
+    "  print(k, v)\n"
+    "end\n"
+    "print(#slots, slots[3.0], slots[1.5], slots.x)\n"
+  );
+
+  lua_close(L);
+}
+
+double sum(lualite::array<double> const& a)
+{
+  double r{};
+
+  for (auto const v: a)
+  {
+    r += v;
+  }
+
+  return r;
+}
+
+std::size_t count_ints(lualite::array<int> const& a)
+{
+  return a.size();
+}
+
+void test_arrays()
+{
+  auto const L(luaL_newstate());
+
+  luaL_openlibs(L);
+
+  lualite::module(L)
+    .def<LLFUNC(halves)>("halves")
+    .def<LLFUNC(sum)>("sum")
+    .def<LLFUNC(count_ints)>("count_ints");
+
+  luaL_dostring(
+    L,
+    "local a = halves(4)\n"
+    "a[2] = 2\n"
+    "print(#a, a[1], a[2], a[5], sum(a), sum({1, 2, 3}))\n"
+    "print(table.concat(a:totable(), \" \"))\n"
+    "print(pcall(count_ints, a))\n"
+    "print(pcall(sum, io.stdout))\n"
+    "print(pcall(sum, 1))\n"
+  );
+
+  lua_close(L);
+}
+
+point mirror(point const& p)
+{
+  return {p.y, p.x};
+}
+
+int mirror(int const i)
+{
+  return -i;
+}
+
+std::vector<point> shift(std::vector<point> v, int const d)
+{
+  for (auto& p: v)
+  {
+    p.x += d;
+    p.y += d;
+  }
+
+  return v;
+}
+
+void test_fields()
+{
+  auto const L(luaL_newstate());
+
+  luaL_openlibs(L);
+
+  lualite::module(L)
+    .def<lualite::overload<point (*)(point const&), &mirror>,
+      lualite::overload<int (*)(int), &mirror> >("mirror")
+    .def<LLFUNC(shift)>("shift");
+
+  luaL_dostring(
+    L,
+    "local p = mirror({x = 1, y = 2})\n"
+    "local q = mirror({y = 5})\n"
+    "print(p.x, p.y, q.x, q.y, mirror(3))\n"
+    "local v = shift({{x = 1, y = 2}, {x = 3}}, 10)\n"
+    "print(#v, v[1].x, v[1].y, v[2].x, v[2].y)\n"
+    "print(pcall(mirror, \"p\"))\n"
+  );
+
+  lua_close(L);
+}
+
+point centroid(lualite::columns<point> const& c)
+{
+  auto const& x(std::get<0>(c));
+  auto const& y(std::get<1>(c));
+
+  point r{};
+
+  for (std::size_t i{}; i != x.size(); ++i)
+  {
+    r.x += x[i];
+    r.y += y[i];
+  }
+
+  if (!x.empty())
+  {
+    r.x /= int(x.size());
+    r.y /= int(y.size());
+  }
+  // else do nothing
+
+  return r;
+}
+
+void test_columns()
+{
+  auto const L(luaL_newstate());
+
+  luaL_openlibs(L);
+
+  lualite::module(L)
+    .def<lualite::overload<point (*)(lualite::columns<point> const&),
+      &centroid> >("centroid");
+
+  luaL_dostring(
+    L,
+    "local c = centroid({{x = 1, y = 2}, {x = 3}, {y = 4}, {x = 8, y = 6}})\n"
+    "local e = centroid({})\n"
+    "print(c.x, c.y, e.x, e.y)\n"
+    "print(pcall(centroid, \"points\"))\n"
+  );
+
+  lua_close(L);
+}
+
+lua_State* count_state;
+
+// raises an error for an empty string, calls inner() back for "nested"
+std::size_t count_chars(lualite::reused<std::string> const s)
+{
+  if (s->empty())
+  {
+    luaL_error(count_state, "empty string");
+  }
+  else if ("nested" == *s)
+  {
+    lua_getglobal(count_state, "inner");
+    lua_call(count_state, 0, 0);
+  }
+  // else do nothing
+
+  return s->size();
+}
+
+void count_errors(lua_State* const L, int const depth)
+{
+  if (depth)
+  {
+    count_errors(L, depth - 1);
+  }
+  else
+  {
+    luaL_dostring(L, "for i = 1, 1000 do pcall(count_chars, \"\") end\n");
+  }
+}
+
+void test_reused()
+{
+  auto const L(luaL_newstate());
+
+  count_state = L;
+
+  luaL_openlibs(L);
+
+  lualite::module(L)
+    .def<LLFUNC(count_chars)>("count_chars");
+
+  luaL_dostring(
+    L,
+    "function inner()\n"
+    "  for i = 1, 1000 do pcall(count_chars, \"\") end\n"
+    "  print(count_chars(\"inner\"))\n"
+    "end\n"
+    "for i = 1, 1000 do pcall(count_chars, \"\") end\n"
+    "print(count_chars(\"nested\"), pcall(count_chars, \"\"))\n"
+  );
+
+  count_errors(L, 100);
+
+  // errors at any depth leave no scratch strings in use
+  std::cout << lualite::detail::scratch<std::string>::objects().size() <<
+    " " << lualite::detail::scratch<std::string>::used() << std::endl;
+
+  lua_close(L);
+}
+
+void test_function_ref()
+{
+  auto const L(luaL_newstate());
+
+  luaL_openlibs(L);
+
+  luaL_dostring(
+    L,
+    "function add(a, b) return a + b end\n"
+    "function greet(s) return \"hello \" .. s end\n"
+  );
+
+  {
+    lualite::function_ref<int (int, int)> const add(L, "add");
+    lualite::function_ref<std::string (char const*)> greet(L, "greet");
+    lualite::function_ref<int (char const*, int)> const bad(L, "add");
+
+    std::cout << add(1, 2) << " " << add(40, 2) << " " << greet("lua") <<
+      std::endl;
+
+    if (auto const r = bad.pcall("one", 1))
+    {
+      std::cout << r.value << std::endl;
+    }
+    else
+    {
+      // the first line of the message, the traceback follows
+      std::string const msg(lua_tostring(L, -1));
+
+      std::cout << msg.substr(0, msg.find('\n')) << std::endl;
+
+      lua_pop(L, 1);
+    }
+
+    auto const moved(std::move(greet));
+
+    std::cout << bool(greet) << " " << bool(moved) << " " <<
+      moved("again") << " " << lua_gettop(L) << std::endl;
+  }
+
+  lua_close(L);
+}
+
+void test_pcall()
+{
+  auto const L(luaL_newstate());
+
+  luaL_openlibs(L);
+
+  luaL_dostring(
+    L,
+    "function divide(a, b)\n"
+    "  if b == 0 then error(\"division by zero\") end\n"
+    "  return math.floor(a / b)\n"
+    "end\n"
+  );
+
+  lua_getglobal(L, "divide");
+
+  if (auto const r = lualite::pcall<int>(L, 7, 2))
+  {
+    std::cout << r.value;
+  }
+  // else do nothing
+
+  // a pair pushes two arguments
+  std::pair<int, int> const args(9, 3);
+
+  lua_getglobal(L, "divide");
+
+  if (auto const r = lualite::pcall<int>(L, args))
+  {
+    std::cout << " " << r.value;
+  }
+  // else do nothing
+
+  lua_getglobal(L, "divide");
+
+  if (auto const r = lualite::pcall<int>(L, 1, 0))
+  {
+    std::cout << " " << r.value << std::endl;
+  }
+  else
+  {
+    // the first line of the message, the traceback follows
+    std::string const msg(lua_tostring(L, -1));
+
+    std::cout << " " << (LUA_ERRRUN == r.status) << " " << r.value << " " <<
+      msg.substr(0, msg.find('\n')) << std::endl;
+
+    lua_pop(L, 1);
+  }
+
+  lua_getglobal(L, "print");
+
+  std::cout << bool(lualite::pcall<void>(L, "void", 1)) << " " <<
+    lua_gettop(L) << std::endl;
+
+  lua_close(L);
+}
+
+void test_batch()
+{
+  auto const L(luaL_newstate());
+
+  luaL_openlibs(L);
+
+  luaL_dostring(
+    L,
+    "function handler(t, n)\n"
+    "  local s = {}\n"
+    "  for i = 1, n do\n"
+    "    local e = t[i]\n"
+    "    s[i] = type(e) == \"table\" and e[1] .. \":\" .. e[2] or e\n"
+    "  end\n"
+    "  print(n, #t, table.concat(s, \" \"))\n"
+    "end\n"
+    "function reject(t, n) error(\"rejected \" .. n) end\n"
+  );
+
+  {
+    lua_getglobal(L, "handler");
+    lualite::batch<std::pair<int, std::string> > pairs(L, -1, 4);
+    lualite::batch<int> ints(L, -1);
+    lua_pop(L, 1);
+
+    lua_getglobal(L, "reject");
+    lualite::batch<int> rejected(L, -1);
+    lua_pop(L, 1);
+
+    // pairs arrive as arrays, a shorter batch clears the rest of the table
+    pairs.emplace(1, "one");
+    pairs.push({2, "two"});
+    pairs.emplace(3, "three");
+    pairs.flush();
+
+    pairs.emplace(4, "four");
+    pairs.flush();
+
+    ints.push(5);
+    ints.push(6);
+    ints.flush();
+
+    // an empty batch does not call the handler
+    auto const r(pairs.flush());
+
+    std::cout << bool(r) << " " << pairs.empty() << std::endl;
+
+    rejected.push(7);
+
+    if (auto const r = rejected.flush())
+    {
+      std::cout << "accepted" << std::endl;
+    }
+    else
+    {
+      // the first line of the message, the traceback follows
+      std::string const msg(lua_tostring(L, -1));
+
+      std::cout << msg.substr(0, msg.find('\n')) << " " <<
+        rejected.empty() << std::endl;
+
+      lua_pop(L, 1);
+    }
+
+    std::cout << lua_gettop(L) << std::endl;
+  }
+
+  lua_close(L);
+}
+
 int main(int argc, char* argv[])
 {
   lua_State* L(luaL_newstate());
@@ -168,7 +982,8 @@ int main(int argc, char* argv[])
       .constructor<int>()
       .inherits<testbase>() // you can add more classes to inherit from
       .enum_("smell", 9)
-      .def<std::tuple<int, std::string, char const*> (testclass::*)(int), &testclass::print>("print")
+      .def<lualite::overload<std::tuple<int, std::string, char const*> (testclass::*)(int), &testclass::print>,
+        lualite::overload<std::vector<std::string> (testclass::*)(std::string) const, &testclass::print> >("print")
       .def<std::vector<std::string> (testclass::*)(std::string) const, &testclass::print>("print_")
       .def<LLFUNC(testclass::pointer)>("pointer")
       .def<LLFUNC(testclass::reference)>("reference")
@@ -180,7 +995,8 @@ int main(int argc, char* argv[])
         .constructor<int>()
         .enum_("smell", 10)
         .def<LLFUNC(testfunc)>("testfunc")
-        .def<std::tuple<int, std::string, char const*> (testclass::*)(int), &testclass::print>("print")
+        .def<lualite::overload<std::tuple<int, std::string, char const*> (testclass::*)(int), &testclass::print>,
+          lualite::overload<std::vector<std::string> (testclass::*)(std::string) const, &testclass::print> >("print")
         .def<std::vector<std::string> (testclass::*)(std::string) const, &testclass::print>("print_")
     )
   }
@@ -211,6 +1027,7 @@ int main(int argc, char* argv[])
     "local tmp1, tmp2, tmp3 = b:pointer():print(100)\n"
     "print(tmp1 .. \" \" .. tmp2 .. \" \" .. tmp3)\n"
     "b:reference():print_(\"msg1\")\n"
+    "b:print(\"msg1\")\n"
     "local a = subscope.testclass.new(1111)\n"
     "print(subscope.testclass.smell)\n"
     "subscope.testclass.testfunc(200, 0, 1)\n"
@@ -223,7 +1040,7 @@ int main(int argc, char* argv[])
     "print(a:test_array(r))\n"
   );
 
-  ::std::cout << ::lualite::class_<testclass>::inherits("testbase") <<
+  ::std::cout << ::lualite::class_<testclass>::inherits(L, "testbase") <<
     ::std::endl;
 
   lua_getglobal(L, "print");
@@ -236,5 +1053,35 @@ int main(int argc, char* argv[])
 
   lua_close(L);
 
+  test_allocators();
+
+  test_scheduler();
+
+  test_worker_pool();
+
+  test_static_properties();
+
+  test_data_members();
+
+  test_checked();
+
+  test_string_ref();
+
+  test_views();
+
+  test_arrays();
+
+  test_fields();
+
+  test_columns();
+
+  test_reused();
+
+  test_function_ref();
+
+  test_pcall();
+
+  test_batch();
+
   return EXIT_SUCCESS;
 }